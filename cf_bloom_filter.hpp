@@ -0,0 +1,332 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+///
+/// This is a single-header library that provides a blocked Bloom filter in a user-given
+/// buffer, and wrappers that put one in front of a `cf::hashset` or `cf::hashmap` so
+/// most lookups of missing entries never touch the table.
+///
+#ifndef CF_BLOOM_FILTER_HPP
+#define CF_BLOOM_FILTER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cf_hashmap.hpp"
+#include "cf_hashset.hpp"
+
+/// This macro calculates the size of a buffer for a filter of n elements with
+/// `bits` bits per element.
+#define CF_BLOOM_FILTER_BUFFER_SIZE(n, bits) (cf::bloom_filter::buffer_size(n, bits))
+
+namespace cf {
+
+/// A Bloom filter that answers "maybe present" or "definitely not present" for hashes.
+/// The filter is split into blocks of 64 bytes, and all bits of a hash are set in the
+/// same block, so a query costs a single cache line when the buffer starts on one.
+/// Eight bits get set per hash. With 10 bits per element about 1% of the hashes that
+/// were never inserted are reported as maybe present, with 16 bits about 0.1%.
+/// Hashes can't be removed, a filter of a set that had a lot of removals should be
+/// rebuilt.
+struct bloom_filter {
+
+	/// The size of a block in bytes.
+	static const size_t BLOCK_SIZE = 64;
+
+private:
+	static const size_t WORDS_PER_BLOCK = BLOCK_SIZE / sizeof(uint32_t);
+
+	uint32_t *m_blocks;
+
+	size_t m_num_blocks;
+
+	size_t m_num_elements;
+
+	// Every hash gets multiplied with these, the upper 9 bits of each product select
+	// one of the 512 bits of the block.
+	static uint32_t _salt(uint32_t i)
+	{
+		static const uint32_t SALTS[8] = {
+			0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+			0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+		};
+		return SALTS[i];
+	}
+
+	// Maps the hash to a block without a division.
+	uint32_t *_block(uint32_t hash) const
+	{
+		size_t index = (size_t) (((uint64_t) hash * m_num_blocks) >> 32);
+		return m_blocks + index * WORDS_PER_BLOCK;
+	}
+
+public:
+
+	/// The size of a buffer that holds a filter for `num_elements` elements with
+	/// `bits_per_element` bits each, rounded up to whole blocks.
+	static constexpr size_t buffer_size(size_t num_elements, size_t bits_per_element = 10)
+	{
+		return (num_elements * bits_per_element + BLOCK_SIZE * 8 - 1) / (BLOCK_SIZE * 8) * BLOCK_SIZE;
+	}
+
+	/// This function constructs a new empty filter using the whole blocks that fit
+	/// into the buffer. The buffer gets cleared here. It should start on a cache line,
+	/// otherwise blocks straddle two of them.
+	/// WARNING: a buffer smaller than `BLOCK_SIZE` results in a filter that must not
+	/// be used. Use the other `create()` if that can happen.
+	static bloom_filter create(size_t buffer_size, void *buffer)
+	{
+		bloom_filter filter = {};
+
+		filter.m_blocks = (uint32_t *) buffer;
+		filter.m_num_blocks = buffer_size / BLOCK_SIZE;
+		filter.m_num_elements = 0;
+
+		filter.clear();
+
+		return filter;
+	}
+
+	/// Like `create()`, but checks the buffer first. Returns false and leaves `filter`
+	/// untouched if the buffer doesn't start on a block or can't hold a single block.
+	static bool create(size_t buffer_size, void *buffer, bloom_filter &filter)
+	{
+		if ((uintptr_t) buffer % BLOCK_SIZE != 0 || buffer_size < BLOCK_SIZE) {
+			return false;
+		}
+
+		filter = create(buffer_size, buffer);
+		return true;
+	}
+
+	/// Adds a hash to the filter.
+	void insert(uint32_t hash)
+	{
+		uint32_t *block = _block(hash);
+
+		for (uint32_t i = 0; i < 8; i++) {
+			uint32_t bit = (hash * _salt(i)) >> 23;
+			block[bit / 32] |= (uint32_t) 1 << (bit % 32);
+		}
+
+		m_num_elements++;
+	}
+
+	/// Returns false if the hash was definitely never inserted, true if it might have
+	/// been. All eight bits get checked without branching in between.
+	bool may_contain(uint32_t hash) const
+	{
+		const uint32_t *block = _block(hash);
+		uint32_t all = 1;
+
+		for (uint32_t i = 0; i < 8; i++) {
+			uint32_t bit = (hash * _salt(i)) >> 23;
+			all &= block[bit / 32] >> (bit % 32);
+		}
+
+		return all & 1;
+	}
+
+	/// Prefetches the block of a hash, for callers that know their next queries ahead
+	/// of time.
+	void prefetch(uint32_t hash) const
+	{
+		hash_group::prefetch(_block(hash));
+	}
+
+	/// Removes all hashes from the filter.
+	void clear()
+	{
+		size_t num_words = m_num_blocks * WORDS_PER_BLOCK;
+
+		for (size_t i = 0; i < num_words; i++) {
+			m_blocks[i] = 0;
+		}
+
+		m_num_elements = 0;
+	}
+
+	/// The number of hashes that were inserted since the filter was created or cleared.
+	size_t num_elements() const
+	{
+		return m_num_elements;
+	}
+
+	/// The number of blocks of the filter.
+	size_t num_blocks() const
+	{
+		return m_num_blocks;
+	}
+};
+
+/// Folds a hash of a hashmap or hashset into the 32 bits the filter uses.
+template <typename THash>
+inline uint32_t bloom_filter_hash(THash hash)
+{
+	return (uint32_t) hash ^ (uint32_t) ((uint64_t) hash >> 32);
+}
+
+/// A `cf::hashset` with a `cf::bloom_filter` in front of it. `has()` asks the filter
+/// first, so values that aren't in the set usually don't cost a cache miss in the much
+/// bigger table. Removed values stay in the filter, so it gets less effective with
+/// many removals, `set()` and `filter()` give access to both parts to rebuild it.
+template <typename T, typename TTraits = hash_traits>
+struct filtered_hashset {
+
+	typedef hashset<T, TTraits> set_type;
+	typedef typename set_type::hash_type hash_type;
+
+private:
+	set_type m_set;
+
+	bloom_filter m_filter;
+
+public:
+
+	/// This function constructs a new set in `set_buffer` with a filter in
+	/// `filter_buffer`, see `cf::hashset::create()` and `cf::bloom_filter::create()`.
+	static filtered_hashset create(size_t set_buffer_size, void *set_buffer, size_t filter_buffer_size, void *filter_buffer)
+	{
+		filtered_hashset set;
+
+		set.m_set = set_type::create(set_buffer_size, set_buffer);
+		set.m_filter = bloom_filter::create(filter_buffer_size, filter_buffer);
+
+		return set;
+	}
+
+	/// Inserts a value into the set and its hash into the filter.
+	void insert(hash_type hash, const T &value)
+	{
+		m_filter.insert(bloom_filter_hash(hash));
+		m_set.insert(hash, value);
+	}
+
+	/// Checks if `value` is an element of the set. The table is only searched if the
+	/// filter says the hash might have been inserted.
+	template <typename TV>
+	bool has(hash_type hash, const TV &value) const
+	{
+		return m_filter.may_contain(bloom_filter_hash(hash)) && m_set.has(hash, value);
+	}
+
+	/// Removes a value from the set. Its hash stays in the filter.
+	template <typename TV>
+	void remove(hash_type hash, const TV &value)
+	{
+		m_set.remove(hash, value);
+	}
+
+	/// The set behind the filter.
+	set_type &set()
+	{
+		return m_set;
+	}
+
+	/// The set behind the filter.
+	const set_type &set() const
+	{
+		return m_set;
+	}
+
+	/// The filter in front of the set.
+	bloom_filter &filter()
+	{
+		return m_filter;
+	}
+
+	/// The number of elements in the set.
+	size_t num_elements() const
+	{
+		return m_set.num_elements();
+	}
+};
+
+/// A `cf::hashmap` with a `cf::bloom_filter` in front of it. Lookups ask the filter
+/// first, so keys that aren't in the map usually don't cost a cache miss in the much
+/// bigger table. Removed keys stay in the filter, so it gets less effective with many
+/// removals, `map()` and `filter()` give access to both parts to rebuild it.
+template <typename TKey, typename TValue, typename TTraits = hash_traits>
+struct filtered_hashmap {
+
+	typedef hashmap<TKey, TValue, TTraits> map_type;
+	typedef typename map_type::hash_type hash_type;
+
+private:
+	map_type m_map;
+
+	bloom_filter m_filter;
+
+public:
+
+	/// This function constructs a new map in `map_buffer` with a filter in
+	/// `filter_buffer`, see `cf::hashmap::create()` and `cf::bloom_filter::create()`.
+	static filtered_hashmap create(size_t map_buffer_size, void *map_buffer, size_t filter_buffer_size, void *filter_buffer)
+	{
+		filtered_hashmap map;
+
+		map.m_map = map_type::create(map_buffer_size, map_buffer);
+		map.m_filter = bloom_filter::create(filter_buffer_size, filter_buffer);
+
+		return map;
+	}
+
+	/// Sets the value of an entry and inserts the hash into the filter.
+	void set(hash_type hash, const TKey &key, const TValue &value)
+	{
+		m_filter.insert(bloom_filter_hash(hash));
+		m_map.set(hash, key, value);
+	}
+
+	/// Like `cf::hashmap::find()`, but the table is only searched if the filter says the
+	/// hash might have been inserted.
+	template <typename TK>
+	TValue *find(hash_type hash, const TK &key)
+	{
+		return m_filter.may_contain(bloom_filter_hash(hash)) ? m_map.find(hash, key) : nullptr;
+	}
+
+	/// Like `cf::hashmap::lookup()`, but the table is only searched if the filter says
+	/// the hash might have been inserted.
+	template <typename TK>
+	bool lookup(hash_type hash, const TK &key, TValue &value) const
+	{
+		return m_filter.may_contain(bloom_filter_hash(hash)) && m_map.lookup(hash, key, value);
+	}
+
+	/// Removes an entry from the map. Its hash stays in the filter.
+	template <typename TK>
+	void remove(hash_type hash, const TK &key)
+	{
+		m_map.remove(hash, key);
+	}
+
+	/// The map behind the filter.
+	map_type &map()
+	{
+		return m_map;
+	}
+
+	/// The map behind the filter.
+	const map_type &map() const
+	{
+		return m_map;
+	}
+
+	/// The filter in front of the map.
+	bloom_filter &filter()
+	{
+		return m_filter;
+	}
+
+	/// The number of entries in the map.
+	size_t num_elements() const
+	{
+		return m_map.num_elements();
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,694 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+///
+/// This header provides hash maps built on top of `cf::hashmap` that can be shared
+/// between threads.
+/// Synchronization uses the `__atomic` builtins of GCC and Clang, so no threading
+/// library is needed.
+///
+#ifndef CF_CONCURRENT_HASHMAP_HPP
+#define CF_CONCURRENT_HASHMAP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cf_hashmap.hpp"
+
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "cf_concurrent_hashmap.hpp needs the __atomic builtins of GCC or Clang"
+#endif
+
+namespace cf {
+
+/// Tells the CPU that we're busy waiting.
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/// A hashmap that can be read by many threads at the same time while a single thread
+/// writes to it.
+/// This is a seqlock: readers never take a lock or write to shared memory, but they
+/// wait while a write is in progress. The writer increments a sequence counter before
+/// and after every modification, readers retry a lookup if the counter was odd or
+/// changed in the meantime. Robin hood displacements in inserts can move other entries
+/// around, a reader that raced with such a write simply tries again.
+/// All slots, keys and values that readers can see are written and read with atomic
+/// operations, word by word, so a lookup that overlaps a write reads torn data but never
+/// races. Readers probe one slot at a time instead of whole groups.
+/// Only one thread may call the writing functions at a time, if there are multiple
+/// writers they need to be serialized by the caller.
+/// Readers copy keys and values from memory that might be written concurrently, so both
+/// have to be POD types.
+/// The capacity is fixed. To resize, create a new map with `copy()` from the writer and
+/// publish it to the readers in whatever way the caller already uses to share the map.
+template <typename TKey, typename TValue, typename TTraits = hash_traits>
+struct concurrent_hashmap {
+
+	static_assert(std::is_trivially_copyable<TKey>::value && std::is_trivially_copyable<TValue>::value,
+	              "readers copy keys and values while they might be written, so they have to be trivially copyable");
+
+	typedef typename hashmap<TKey, TValue, TTraits>::hash_type hash_type;
+
+private:
+	typedef hashmap<TKey, TValue, TTraits> map_type;
+	typedef typename map_type::hash_policy hash_policy;
+	typedef typename map_type::slot_type slot_type;
+	typedef typename map_type::equality_policy equality_policy;
+
+	map_type m_map;
+
+	// Written by the writer on every modification, so it gets its own cache line.
+	alignas(CF_CACHE_LINE_SIZE) uint32_t m_sequence;
+
+	uint8_t m_padding[CF_CACHE_LINE_SIZE - sizeof(uint32_t)];
+
+	// The words keys and values get copied in, the biggest ones their size and
+	// alignment allow.
+	template <typename T>
+	struct _words {
+		typedef typename std::conditional<sizeof(T) % 8 == 0 && alignof(T) >= 8, uint64_t,
+			typename std::conditional<sizeof(T) % 4 == 0 && alignof(T) >= 4, uint32_t,
+			typename std::conditional<sizeof(T) % 2 == 0 && alignof(T) >= 2, uint16_t,
+			uint8_t>::type>::type>::type word;
+
+		typedef word __attribute__((__may_alias__)) alias;
+
+		static const size_t count = sizeof(T) / sizeof(word);
+	};
+
+	// Data stores are release stores and reader loads are acquire loads: a reader that
+	// sees anything of a write also sees the odd sequence number stored before it, so it
+	// notices the race when it checks the counter again.
+	template <typename T>
+	static void _load(T &dst, const T &src)
+	{
+		typedef typename _words<T>::alias word;
+
+		const word *from = (const word *) &src;
+		word *to = (word *) &dst;
+
+		for (size_t i = 0; i < _words<T>::count; i++) {
+			to[i] = __atomic_load_n(from + i, __ATOMIC_ACQUIRE);
+		}
+	}
+
+	template <typename T>
+	static void _store(T &dst, const T &src)
+	{
+		typedef typename _words<T>::alias word;
+
+		const word *from = (const word *) &src;
+		word *to = (word *) &dst;
+
+		for (size_t i = 0; i < _words<T>::count; i++) {
+			__atomic_store_n(to + i, from[i], __ATOMIC_RELEASE);
+		}
+	}
+
+	void _write_begin()
+	{
+		__atomic_store_n(&m_sequence, m_sequence + 1, __ATOMIC_RELAXED);
+	}
+
+	void _write_end()
+	{
+		__atomic_store_n(&m_sequence, m_sequence + 1, __ATOMIC_RELEASE);
+	}
+
+	// Writes an entry into a slot readers might be looking at.
+	void _publish(uint32_t pos, slot_type slot, const TKey &key, const TValue &value)
+	{
+		_store(m_map._key(pos), key);
+		_store(m_map._value(pos), value);
+		__atomic_store_n(&m_map._slot(pos), slot, __ATOMIC_RELEASE);
+	}
+
+	// Inserts a new entry with robin hood displacement like `hashmap::set()`, but every
+	// slot gets written with `_publish()`. Displaced entries are carried along until
+	// they find an empty slot or a tombstone.
+	void _insert(hash_type hash, TKey key, TValue value)
+	{
+		uint32_t pos = m_map._home(hash);
+		uint32_t distance = 0;
+
+		// Same walk as `hashmap::_find_or_insert`, so both give up in the same cases.
+		while (distance < m_map.m_capacity && !hash_policy::is_empty(m_map._slot(pos)) &&
+		       m_map._get_probe_distance(pos, m_map._slot(pos)) >= distance) {
+			pos = m_map._next(pos);
+			distance++;
+		}
+
+		if (distance == m_map.m_capacity || m_map.m_num_elements == m_map.m_capacity) {
+			return;
+		}
+
+		if (hash_policy::max_distance < m_map.m_capacity && !m_map._can_insert(pos, distance)) {
+			return;
+		}
+
+		slot_type slot = hash_policy::make(hash, distance);
+
+		for (;;) {
+			slot_type existing = m_map._slot(pos);
+
+			if (hash_policy::is_empty(existing)) {
+				break;
+			}
+
+			uint32_t existing_distance = m_map._get_probe_distance(pos, existing);
+			if (existing_distance < distance) {
+				if (hash_policy::is_deleted(existing)) {
+					break;
+				}
+
+				TKey moved_key = m_map._key(pos);
+				TValue moved_value = m_map._value(pos);
+
+				_publish(pos, hash_policy::with_distance(slot, distance), key, value);
+
+				slot = existing;
+				key = moved_key;
+				value = moved_value;
+				distance = existing_distance;
+			}
+
+			pos = m_map._next(pos);
+			distance++;
+		}
+
+		_publish(pos, hash_policy::with_distance(slot, distance), key, value);
+		m_map.m_num_elements++;
+	}
+
+	// Removes the entry in `pos` like `hashmap::remove()`, with atomic stores.
+	void _remove_at(uint32_t pos)
+	{
+		m_map.m_num_elements--;
+
+		if (!TTraits::backward_shift_deletion) {
+			__atomic_store_n(&m_map._slot(pos), hash_policy::mark_deleted(m_map._slot(pos)), __ATOMIC_RELEASE);
+			return;
+		}
+
+		uint32_t next = m_map._next(pos);
+		for (size_t i = 1; i < m_map.m_capacity; i++) {
+			slot_type slot = m_map._slot(next);
+			if (hash_policy::is_empty(slot)) {
+				break;
+			}
+
+			uint32_t distance = m_map._get_probe_distance(next, slot);
+			if (distance == 0) {
+				break;
+			}
+
+			_publish(pos, hash_policy::with_distance(slot, distance - 1), m_map._key(next), m_map._value(next));
+
+			pos = next;
+			next = m_map._next(next);
+		}
+
+		__atomic_store_n(&m_map._slot(pos), hash_policy::EMPTY_HASH, __ATOMIC_RELEASE);
+	}
+
+	// The probing of `hashmap::lookup()` one slot at a time, with every shared word read
+	// by `_load()`. Torn data only makes this give up early or miss, the sequence
+	// counter tells the caller to ignore the result then.
+	bool _lookup(hash_type hash, const TKey &key, TValue &value) const
+	{
+		uint32_t pos = m_map._home(hash);
+		uint32_t distance = 0;
+
+		while (distance < m_map.m_capacity && distance <= hash_policy::max_distance) {
+			slot_type slot = __atomic_load_n(&m_map._slot(pos), __ATOMIC_ACQUIRE);
+
+			if (hash_policy::is_empty(slot) || distance > m_map._get_probe_distance(pos, slot)) {
+				return false;
+			}
+
+			if (slot == hash_policy::make(hash, distance)) {
+				TKey candidate;
+				_load(candidate, m_map._key(pos));
+
+				if (equality_policy::equal(candidate, key)) {
+					_load(value, m_map._value(pos));
+					return true;
+				}
+			}
+
+			pos = m_map._next(pos);
+			distance++;
+		}
+
+		return false;
+	}
+
+public:
+
+	/// The size of a buffer that can hold at least `num_elements` entries.
+	static constexpr size_t buffer_size(size_t num_elements)
+	{
+		return map_type::buffer_size(num_elements);
+	}
+
+	/// Constructs a new map that uses `buffer` as the storage, like `hashmap::create()`.
+	/// The map has to be created before it gets shared with other threads.
+	static concurrent_hashmap create(size_t buffer_size, void *buffer)
+	{
+		concurrent_hashmap map = {};
+
+		map.m_map = map_type::create(buffer_size, buffer);
+		map.m_sequence = 0;
+
+		return map;
+	}
+
+	/// Associate a key with a value, like `hashmap::set()`. Writer only.
+	void set(hash_type hash, const TKey &key, const TValue &value)
+	{
+		hash = map_type::_hash(hash);
+
+		// Only the writer modifies the map, so it can look at it without the atomics.
+		uint32_t pos = 0;
+		bool exists = m_map._lookup_pos(hash, key, pos);
+
+		_write_begin();
+
+		if (exists) {
+			_store(m_map._value(pos), value);
+		} else {
+			_insert(hash, key, value);
+		}
+
+		_write_end();
+	}
+
+	/// Remove an entry, like `hashmap::remove()`. Writer only.
+	void remove(hash_type hash, const TKey &key)
+	{
+		uint32_t pos = 0;
+		if (!m_map._lookup_pos(map_type::_hash(hash), key, pos)) {
+			return;
+		}
+
+		_write_begin();
+		_remove_at(pos);
+		_write_end();
+	}
+
+	/// Lookup a value, like `hashmap::lookup()`. This can be called from any number of
+	/// threads at the same time, also while the writer modifies the map. A lookup that
+	/// overlaps a write waits for it to finish and starts over.
+	bool lookup(hash_type hash, const TKey &key, TValue &value) const
+	{
+		hash = map_type::_hash(hash);
+
+		while (true) {
+			uint32_t before = __atomic_load_n(&m_sequence, __ATOMIC_ACQUIRE);
+
+			if (before & 1) {
+				// a write is in progress
+				cpu_relax();
+				continue;
+			}
+
+			TValue result;
+			bool found = _lookup(hash, key, result);
+
+			uint32_t after = __atomic_load_n(&m_sequence, __ATOMIC_RELAXED);
+
+			if (before == after) {
+				if (found) {
+					value = result;
+				}
+				return found;
+			}
+		}
+	}
+
+	/// Get the value associated with the given hash and key. Can be called concurrently.
+	/// WARNING: If the entry was not found then the return value is **undefined**.
+	inline TValue get(hash_type hash, const TKey &key) const
+	{
+		TValue value;
+		lookup(hash, key, value);
+		return value;
+	}
+
+	/// Creates a new map in a different buffer with all entries of this map.
+	/// Writer only, readers can keep using this map while the copy is made.
+	concurrent_hashmap copy(size_t buffer_size, void *buffer) const
+	{
+		concurrent_hashmap map = {};
+
+		map.m_map = m_map.copy(buffer_size, buffer);
+		map.m_sequence = 0;
+
+		return map;
+	}
+
+	/// The load factor of the map. Writer only.
+	inline float load_factor() const
+	{
+		return m_map.load_factor();
+	}
+
+	/// The number of elements in this map. Writer only.
+	size_t num_elements() const
+	{
+		return m_map.num_elements();
+	}
+
+	/// The capacity of how many elements *could* be held in this map.
+	size_t capacity() const
+	{
+		return m_map.capacity();
+	}
+};
+
+/// A spinlock that occupies a full cache line together with the data it protects.
+/// Waiting threads only read the lock until it looks free, so they don't keep stealing
+/// the cache line from the owner.
+struct spinlock {
+
+	uint32_t m_locked;
+
+	void lock()
+	{
+		while (__atomic_exchange_n(&m_locked, 1, __ATOMIC_ACQUIRE)) {
+			while (__atomic_load_n(&m_locked, __ATOMIC_RELAXED)) {
+				cpu_relax();
+			}
+		}
+	}
+
+	void unlock()
+	{
+		__atomic_store_n(&m_locked, 0, __ATOMIC_RELEASE);
+	}
+};
+
+/// A hashmap that is split into `NumShards` independent `cf::hashmap`s, each protected
+/// by its own spinlock, so threads that write to different shards don't contend.
+/// The shard is selected by the high bits of the hash while the low bits keep selecting
+/// the slot inside of the shard. `NumShards` has to be a power of two, and the hashes
+/// need good high bits (so `cf::hash64` needs actual 64 bit hashes).
+/// The user buffer is split evenly between the shards, every shard uses the same layout
+/// as a plain `cf::hashmap`.
+template <typename TKey, typename TValue, size_t NumShards, typename TTraits = hash_traits>
+struct sharded_hashmap {
+
+	static_assert(NumShards > 0 && (NumShards & (NumShards - 1)) == 0,
+	              "the number of shards has to be a power of two");
+
+private:
+	typedef hashmap<TKey, TValue, TTraits> map_type;
+
+public:
+	typedef typename map_type::hash_type hash_type;
+
+private:
+	struct alignas(CF_CACHE_LINE_SIZE) shard {
+		mutable spinlock lock;
+		map_type map;
+	};
+
+	static constexpr uint32_t _log2(size_t n)
+	{
+		return n <= 1 ? 0 : 1 + _log2(n / 2);
+	}
+
+	static const uint32_t HASH_BITS = sizeof(hash_type) * 8;
+	static const uint32_t SHARD_BITS = _log2(NumShards);
+
+	shard m_shards[NumShards];
+
+	// The two step shifts keep a single shard from shifting by the full width.
+	static size_t _shard_index(hash_type hash)
+	{
+		return (size_t) ((hash >> (HASH_BITS - SHARD_BITS - 1)) >> 1);
+	}
+
+	// All hashes in one shard share their high bits. Some hash policies store these
+	// bits (the fingerprint of `cf::fingerprint8` for example), so the low bits are
+	// mixed into them before the hash is handed to the shard.
+	static hash_type _shard_hash(hash_type hash)
+	{
+		return hash ^ ((hash << (HASH_BITS - SHARD_BITS - 1)) << 1);
+	}
+
+	// Turns the hash function of the caller into one that produces the hashes as
+	// they are stored in the shards.
+	template <typename THashFn>
+	struct _shard_hash_fn {
+		THashFn hash_fn;
+
+		hash_type operator()(const TKey &key) const
+		{
+			return _shard_hash(hash_fn(key));
+		}
+	};
+
+	// Region sizes of the shards are rounded to whole cache lines so the shards don't
+	// share any lines in the buffer.
+	static constexpr size_t _round_to_line(size_t size)
+	{
+		return (size + CF_CACHE_LINE_SIZE - 1) / CF_CACHE_LINE_SIZE * CF_CACHE_LINE_SIZE;
+	}
+
+public:
+
+	/// The size of a buffer that can hold at least `num_elements` entries, assuming
+	/// the hashes distribute evenly across the shards.
+	static constexpr size_t buffer_size(size_t num_elements)
+	{
+		return NumShards * _round_to_line(map_type::buffer_size((num_elements + NumShards - 1) / NumShards));
+	}
+
+	/// The number of shards.
+	static constexpr size_t num_shards()
+	{
+		return NumShards;
+	}
+
+	/// Constructs a new map that uses `buffer` as the storage. Every shard gets an
+	/// equal part of the buffer.
+	/// The map has to be created before it gets shared with other threads.
+	static sharded_hashmap create(size_t buffer_size, void *buffer)
+	{
+		sharded_hashmap map = {};
+
+		size_t shard_size = buffer_size / NumShards / CF_CACHE_LINE_SIZE * CF_CACHE_LINE_SIZE;
+
+		for (size_t i = 0; i < NumShards; i++) {
+			uint8_t *shard_buffer = (uint8_t *) buffer + i * shard_size;
+			map.m_shards[i].lock.m_locked = 0;
+			map.m_shards[i].map = map_type::create(shard_size, shard_buffer);
+		}
+
+		return map;
+	}
+
+	/// Associate a key with a value, like `hashmap::set()`.
+	void set(hash_type hash, const TKey &key, const TValue &value)
+	{
+		shard &s = m_shards[_shard_index(hash)];
+
+		s.lock.lock();
+		s.map.set(_shard_hash(hash), key, value);
+		s.lock.unlock();
+	}
+
+	/// Lookup a value, like `hashmap::lookup()`.
+	bool lookup(hash_type hash, const TKey &key, TValue &value) const
+	{
+		const shard &s = m_shards[_shard_index(hash)];
+
+		s.lock.lock();
+		bool found = s.map.lookup(_shard_hash(hash), key, value);
+		s.lock.unlock();
+
+		return found;
+	}
+
+	/// Get the value associated with the given hash and key.
+	/// WARNING: If the entry was not found then the return value is **undefined**.
+	inline TValue get(hash_type hash, const TKey &key) const
+	{
+		TValue value;
+		lookup(hash, key, value);
+		return value;
+	}
+
+	/// Remove an entry, like `hashmap::remove()`.
+	void remove(hash_type hash, const TKey &key)
+	{
+		shard &s = m_shards[_shard_index(hash)];
+
+		s.lock.lock();
+		s.map.remove(_shard_hash(hash), key);
+		s.lock.unlock();
+	}
+
+	/// Modifies the value of an entry in place while its shard is locked, like
+	/// `hashmap::upsert()`. `fn` shouldn't access the map itself.
+	template <typename TFn>
+	bool upsert(hash_type hash, const TKey &key, TFn fn)
+	{
+		shard &s = m_shards[_shard_index(hash)];
+
+		s.lock.lock();
+		bool stored = s.map.upsert(_shard_hash(hash), key, fn);
+		s.lock.unlock();
+
+		return stored;
+	}
+
+	/// Moves a single shard into a new buffer, for example when that shard got a lot
+	/// fuller than the others. Other shards can be used while this is running.
+	/// Returns the buffer the shard used before, which can be freed afterwards.
+	void *copy_shard(size_t index, size_t buffer_size, void *buffer)
+	{
+		shard &s = m_shards[index];
+
+		s.lock.lock();
+		void *old_buffer = s.map.m_buffer;
+		s.map = s.map.copy(buffer_size, buffer);
+		s.lock.unlock();
+
+		return old_buffer;
+	}
+
+	/// Like `copy_shard()`, but the hashes of the entries get calculated again by
+	/// calling `hash_fn(key)`.
+	template <typename THashFn>
+	void *copy_shard(size_t index, size_t buffer_size, void *buffer, THashFn hash_fn)
+	{
+		shard &s = m_shards[index];
+		_shard_hash_fn<THashFn> shard_hash_fn = { hash_fn };
+
+		s.lock.lock();
+		void *old_buffer = s.map.m_buffer;
+		s.map = s.map.copy(buffer_size, buffer, shard_hash_fn);
+		s.lock.unlock();
+
+		return old_buffer;
+	}
+
+	/// Creates a new map in a different buffer with all entries of this map.
+	sharded_hashmap copy(size_t buffer_size, void *buffer) const
+	{
+		sharded_hashmap map = {};
+
+		size_t shard_size = buffer_size / NumShards / CF_CACHE_LINE_SIZE * CF_CACHE_LINE_SIZE;
+
+		for (size_t i = 0; i < NumShards; i++) {
+			uint8_t *shard_buffer = (uint8_t *) buffer + i * shard_size;
+			const shard &s = m_shards[i];
+
+			s.lock.lock();
+			map.m_shards[i].lock.m_locked = 0;
+			map.m_shards[i].map = s.map.copy(shard_size, shard_buffer);
+			s.lock.unlock();
+		}
+
+		return map;
+	}
+
+	/// Like `copy()`, but the hashes of the entries get calculated again by calling
+	/// `hash_fn(key)`. This works with every hash policy, like `hashmap::copy()`.
+	template <typename THashFn>
+	sharded_hashmap copy(size_t buffer_size, void *buffer, THashFn hash_fn) const
+	{
+		sharded_hashmap map = {};
+
+		size_t shard_size = buffer_size / NumShards / CF_CACHE_LINE_SIZE * CF_CACHE_LINE_SIZE;
+		_shard_hash_fn<THashFn> shard_hash_fn = { hash_fn };
+
+		for (size_t i = 0; i < NumShards; i++) {
+			uint8_t *shard_buffer = (uint8_t *) buffer + i * shard_size;
+			const shard &s = m_shards[i];
+
+			s.lock.lock();
+			map.m_shards[i].lock.m_locked = 0;
+			map.m_shards[i].map = s.map.copy(shard_size, shard_buffer, shard_hash_fn);
+			s.lock.unlock();
+		}
+
+		return map;
+	}
+
+	/// The load factor of a single shard.
+	float shard_load_factor(size_t index) const
+	{
+		const shard &s = m_shards[index];
+
+		s.lock.lock();
+		float load_factor = s.map.load_factor();
+		s.lock.unlock();
+
+		return load_factor;
+	}
+
+	/// The load factor of the whole map.
+	inline float load_factor() const
+	{
+		size_t capacity = 0;
+		size_t num_elements = 0;
+
+		for (size_t i = 0; i < NumShards; i++) {
+			const shard &s = m_shards[i];
+
+			s.lock.lock();
+			capacity += s.map.capacity();
+			num_elements += s.map.num_elements();
+			s.lock.unlock();
+		}
+
+		return num_elements / (float) capacity;
+	}
+
+	/// The number of elements in all shards. Since the shards are locked one after the
+	/// other this is only a snapshot if other threads modify the map at the same time.
+	size_t num_elements() const
+	{
+		size_t num_elements = 0;
+
+		for (size_t i = 0; i < NumShards; i++) {
+			const shard &s = m_shards[i];
+
+			s.lock.lock();
+			num_elements += s.map.num_elements();
+			s.lock.unlock();
+		}
+
+		return num_elements;
+	}
+
+	/// The capacity of how many elements *could* be held in this map.
+	size_t capacity() const
+	{
+		size_t capacity = 0;
+
+		for (size_t i = 0; i < NumShards; i++) {
+			const shard &s = m_shards[i];
+
+			s.lock.lock();
+			capacity += s.map.capacity();
+			s.lock.unlock();
+		}
+
+		return capacity;
+	}
+};
+
+}
+
+#endif
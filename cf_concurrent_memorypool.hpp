@@ -0,0 +1,239 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+///
+/// This header provides a memory pool for fixed-size allocations that can be shared
+/// between threads.
+/// Synchronization uses the `__atomic` builtins of GCC and Clang, so no threading
+/// library is needed.
+///
+#ifndef CF_CONCURRENT_MEMORYPOOL_HPP
+#define CF_CONCURRENT_MEMORYPOOL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "cf_concurrent_memorypool.hpp needs the __atomic builtins of GCC or Clang"
+#endif
+
+#ifndef CF_CACHE_LINE_SIZE
+#define CF_CACHE_LINE_SIZE 64
+#endif
+
+/// This macro calculates the size of a buffer that can hold n elements of type `type`.
+/// Free elements hold two indices, so every element needs at least 8 bytes.
+#define CF_CONCURRENT_MEMORYPOOL_BUFFER_SIZE(type, n) \
+	((sizeof(type) > 2 * sizeof(uint32_t) ? sizeof(type) : 2 * sizeof(uint32_t)) * n)
+
+namespace cf {
+
+/// A memory pool like `cf::memorypool` that many threads can allocate from and free to
+/// at the same time.
+/// Every thread keeps a `cache` of free elements, which `allocate()` and `free()` work
+/// on without any synchronization. Only when a cache runs empty or full, half of its
+/// capacity gets moved from or to a central stack in a single atomic operation. The
+/// central stack holds chains of free elements that are linked through the elements
+/// themselves, and its head carries a tag that changes on every operation, so a chain
+/// that got popped and pushed again in the meantime can't confuse a concurrent pop.
+/// Elements can be freed by any thread, they go into the cache of the freeing thread.
+/// The caches belong to the caller, one per thread (for example a `thread_local`
+/// variable or a member of a worker), zero-initialized before their first use. Call
+/// `flush()` before a cache goes away, otherwise the elements in it are lost to the pool.
+template <typename T, uint32_t CacheSize = 64>
+struct concurrent_memorypool {
+
+	static_assert(CacheSize >= 2, "a cache has to be able to hold at least two batches of one element");
+
+	/// The free elements a thread works with. Zero-initialize it before using it.
+	struct cache {
+		uint32_t count;
+		uint32_t indices[CacheSize];
+	};
+
+private:
+	static const uint32_t NIL = 0xFFFFFFFF;
+
+	// How many elements move between a cache and the central stack at once.
+	static const uint32_t BATCH_SIZE = CacheSize / 2;
+
+	// A free element links to the next element of its chain. The first element of a
+	// chain also links to the next chain on the central stack.
+	struct link_t {
+		uint32_t next;
+		uint32_t next_chain;
+	};
+
+	typedef union { T value; link_t link; } element_t;
+
+	element_t *m_buffer;
+
+	size_t m_capacity;
+
+	// The first chain in the lower half and the tag in the upper half. Every thread
+	// that runs out of or has too many free elements writes it, so it gets its own
+	// cache line.
+	alignas(CF_CACHE_LINE_SIZE) uint64_t m_head;
+
+	// The number of elements on the central stack.
+	size_t m_num_free;
+
+	uint8_t m_padding[CF_CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(size_t)];
+
+	static uint32_t _index(uint64_t head)
+	{
+		return (uint32_t) head;
+	}
+
+	static uint64_t _make_head(uint64_t old_head, uint32_t index)
+	{
+		return (((old_head >> 32) + 1) << 32) | index;
+	}
+
+	// Pops a chain off the central stack into the cache. Returns false if there was none.
+	bool _refill(cache &c)
+	{
+		uint64_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+		uint32_t first;
+
+		while (true) {
+			first = _index(head);
+			if (first == NIL) {
+				return false;
+			}
+
+			// The chain might have been popped by another thread since `head` was
+			// read, then the tag changed and the exchange below fails.
+			uint32_t next_chain = __atomic_load_n(&m_buffer[first].link.next_chain, __ATOMIC_RELAXED);
+
+			if (__atomic_compare_exchange_n(&m_head, &head, _make_head(head, next_chain), true,
+			                                __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+		}
+
+		for (uint32_t index = first; index != NIL; index = m_buffer[index].link.next) {
+			c.indices[c.count++] = index;
+		}
+
+		__atomic_fetch_sub(&m_num_free, c.count, __ATOMIC_RELAXED);
+
+		return true;
+	}
+
+	// Moves the last `n` elements of the cache to the central stack as a single chain.
+	void _flush(cache &c, uint32_t n)
+	{
+		uint32_t *indices = c.indices + c.count - n;
+
+		for (uint32_t i = 0; i + 1 < n; i++) {
+			m_buffer[indices[i]].link.next = indices[i + 1];
+		}
+		m_buffer[indices[n - 1]].link.next = NIL;
+
+		uint32_t first = indices[0];
+		uint64_t head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+
+		do {
+			__atomic_store_n(&m_buffer[first].link.next_chain, _index(head), __ATOMIC_RELAXED);
+		} while (!__atomic_compare_exchange_n(&m_head, &head, _make_head(head, first), true,
+		                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+		__atomic_fetch_add(&m_num_free, n, __ATOMIC_RELAXED);
+
+		c.count -= n;
+	}
+
+public:
+
+	/// Constructs a new pool that draws its elements from `buffer`, which should be
+	/// sized with `CF_CONCURRENT_MEMORYPOOL_BUFFER_SIZE`. All elements start out on the
+	/// central stack. The pool must not be copied or moved once threads use it.
+	static concurrent_memorypool create(size_t buffer_size, void *buffer)
+	{
+		concurrent_memorypool pool = {};
+
+		pool.m_buffer = (element_t *) buffer;
+		pool.m_capacity = buffer_size / sizeof(element_t);
+
+		if (pool.m_capacity >= NIL) {
+			pool.m_capacity = NIL - 1;
+		}
+
+		uint32_t capacity = (uint32_t) pool.m_capacity;
+
+		// Chains of `BATCH_SIZE` elements each, in the order of the buffer.
+		for (uint32_t i = 0; i < capacity; i++) {
+			bool last_of_chain = (i + 1) % BATCH_SIZE == 0 || i + 1 == capacity;
+			pool.m_buffer[i].link.next = last_of_chain ? NIL : i + 1;
+
+			if (i % BATCH_SIZE == 0) {
+				pool.m_buffer[i].link.next_chain = i + BATCH_SIZE < capacity ? i + BATCH_SIZE : NIL;
+			}
+		}
+
+		pool.m_head = capacity > 0 ? 0 : NIL;
+		pool.m_num_free = capacity;
+
+		return pool;
+	}
+
+	/// Allocate a new element of type `T`, from the cache of the calling thread if
+	/// possible.
+	/// If not enough space is available, `nullptr` will be returned. Elements that are
+	/// sitting in the caches of other threads are not available to this thread.
+	T *allocate(cache &c)
+	{
+		if (c.count == 0 && !_refill(c)) {
+			return nullptr;
+		}
+
+		c.count--;
+		return &m_buffer[c.indices[c.count]].value;
+	}
+
+	/// Free a previously used element, no matter which thread allocated it. The element
+	/// goes into the cache of the calling thread.
+	void free(cache &c, T *element)
+	{
+		if (c.count == CacheSize) {
+			_flush(c, BATCH_SIZE);
+		}
+
+		c.indices[c.count++] = (uint32_t) ((element_t *) element - m_buffer);
+	}
+
+	/// Moves all elements of a cache back to the central stack, so other threads can
+	/// allocate them.
+	void flush(cache &c)
+	{
+		while (c.count > 0) {
+			_flush(c, c.count < BATCH_SIZE ? c.count : BATCH_SIZE);
+		}
+	}
+
+	/// The load factor of the memory pool (from 0.0 to 1.0). Elements in the caches of
+	/// threads count as used.
+	float load_factor() const
+	{
+		return (float) num_elements() / m_capacity;
+	}
+
+	/// The number of elements that aren't on the central stack, which are the used
+	/// elements and the ones in the caches of threads.
+	size_t num_elements() const
+	{
+		return m_capacity - __atomic_load_n(&m_num_free, __ATOMIC_RELAXED);
+	}
+
+	/// The maximum number of elements the memory pool can hold.
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,1301 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+///
+/// This header provides the policies that `cf::hashmap` and `cf::hashset` are
+/// configured with and the traits that combine them, the groups of hashes that probes
+/// compare at once and the built-in hash functions. Both containers include it, so
+/// they always share the same policies.
+///
+#ifndef CF_HASH_POLICIES_HPP
+#define CF_HASH_POLICIES_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// Probing compares a whole group of hashes at once when vector instructions are
+// available. Define CF_NO_SIMD to always use the scalar implementation.
+#if !defined(CF_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define CF_HASH_GROUP_AVX2
+#elif !defined(CF_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CF_HASH_GROUP_SSE2
+#elif !defined(CF_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CF_HASH_GROUP_NEON
+#endif
+
+namespace cf {
+
+/// Rounds `n` up to the next power of two. Useful for sizing buffers of containers
+/// that use the `capacity_pow2` policy.
+constexpr size_t pow2_ceil(size_t n, size_t p = 1)
+{
+	return p >= n ? p : pow2_ceil(n, p << 1);
+}
+
+/// The size of a cache line. The regions of a buffer start on a multiple of it, so they
+/// never share a cache line if the buffer starts on one.
+#ifndef CF_CACHE_LINE_SIZE
+#define CF_CACHE_LINE_SIZE 64
+#endif
+
+/// Rounds `offset` up to a multiple of `alignment`.
+constexpr size_t align_up(size_t offset, size_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+/// The alignment of the start of a region holding elements of type `T`.
+template <typename T>
+constexpr size_t region_alignment()
+{
+	return alignof(T) > CF_CACHE_LINE_SIZE ? alignof(T) : CF_CACHE_LINE_SIZE;
+}
+
+/// Where a region of elements of type `T` starts if the region before it ends at `end`.
+template <typename T>
+constexpr size_t region_start(size_t end)
+{
+	return align_up(end, region_alignment<T>());
+}
+
+/// Capacity policy that uses every slot the buffer can hold and maps hashes to slots
+/// with a modulo. This is the default, use it when buffers are sized to an exact
+/// number of elements.
+struct capacity_modulo {
+	static const uint32_t snapshot_id = 1;
+
+	static constexpr size_t slots_for(size_t num_elements)
+	{
+		return num_elements;
+	}
+
+	static size_t adjust(size_t max_capacity)
+	{
+		return max_capacity;
+	}
+
+	template <typename THash>
+	static uint32_t index(THash hash, size_t capacity)
+	{
+		return (uint32_t) (hash % capacity);
+	}
+
+	static uint32_t next(uint32_t pos, size_t capacity)
+	{
+		pos++;
+		return pos == capacity ? 0 : pos;
+	}
+
+	static uint32_t distance(uint32_t pos, uint32_t home, size_t capacity)
+	{
+		return pos >= home ? pos - home : pos + capacity - home;
+	}
+};
+
+/// Capacity policy that rounds the capacity down to a power of two, so slots can be
+/// computed by masking the hash instead of dividing by the capacity.
+/// Buffers for this policy should be sized with the `_POW2` buffer size macros,
+/// otherwise up to half of the buffer stays unused.
+struct capacity_pow2 {
+	static const uint32_t snapshot_id = 2;
+
+	static constexpr size_t slots_for(size_t num_elements)
+	{
+		return pow2_ceil(num_elements);
+	}
+
+	static size_t adjust(size_t max_capacity)
+	{
+		size_t capacity = 1;
+		while (capacity <= max_capacity / 2) {
+			capacity <<= 1;
+		}
+		return max_capacity == 0 ? 0 : capacity;
+	}
+
+	template <typename THash>
+	static uint32_t index(THash hash, size_t capacity)
+	{
+		return (uint32_t) (hash & (capacity - 1));
+	}
+
+	static uint32_t next(uint32_t pos, size_t capacity)
+	{
+		return (pos + 1) & (capacity - 1);
+	}
+
+	static uint32_t distance(uint32_t pos, uint32_t home, size_t capacity)
+	{
+		return (pos - home) & (capacity - 1);
+	}
+};
+
+/// Capacity policy for tables whose capacity is known at compile time, like the ones of
+/// `cf::static_hashmap` and `cf::static_hashset`. The slot math uses the constant `N`
+/// instead of the capacity stored in the table, so it compiles down to a mask if `N` is
+/// a power of two and to a multiplication otherwise. Tables get exactly `N` slots, or
+/// none if the buffer is too small for that.
+template <size_t N>
+struct capacity_fixed {
+	static_assert(N > 0 && N <= 0xFFFFFFFF, "slot positions are 32 bit");
+
+	static const uint32_t snapshot_id = 3;
+
+	static const bool is_pow2 = (N & (N - 1)) == 0;
+
+	static constexpr size_t slots_for(size_t)
+	{
+		return N;
+	}
+
+	static size_t adjust(size_t max_capacity)
+	{
+		return max_capacity >= N ? N : 0;
+	}
+
+	template <typename THash>
+	static uint32_t index(THash hash, size_t)
+	{
+		return (uint32_t) (is_pow2 ? hash & (N - 1) : hash % N);
+	}
+
+	static uint32_t next(uint32_t pos, size_t)
+	{
+		pos++;
+		return is_pow2 ? pos & (N - 1) : (pos == N ? 0 : pos);
+	}
+
+	static uint32_t distance(uint32_t pos, uint32_t home, size_t)
+	{
+		return is_pow2 ? (pos - home) & (N - 1) : (pos >= home ? pos - home : pos + N - home);
+	}
+};
+
+/// Storage of `Size` bytes inside of an object, for containers that bring their own
+/// buffer. It's a base class of those so it gets constructed before the container.
+template <size_t Size, size_t Alignment>
+struct inline_buffer {
+	alignas(Alignment) uint8_t m_storage[Size];
+};
+
+/// Compares a group of consecutive entries of a hashes region against a hash.
+/// `match()` returns a bit mask with a bit set for each lane that equals the hash and
+/// writes a mask of the empty lanes to `empty`. Lane 0 is the lowest bit.
+/// `match_stepped()` does the same, but compares lane `i` against `first + i * step`.
+/// `occupied()` returns a mask of the lanes that hold a live entry, which are the lanes
+/// that are neither empty (0) nor marked as deleted (highest bit set).
+/// Without vector instructions a group is a single slot.
+struct hash_group {
+#if defined(CF_HASH_GROUP_AVX2)
+	static const uint32_t width = 8;
+
+	static uint32_t match(const uint32_t *hashes, uint32_t hash, uint32_t &empty)
+	{
+		__m256i group = _mm256_loadu_si256((const __m256i *) hashes);
+		__m256i matches = _mm256_cmpeq_epi32(group, _mm256_set1_epi32((int) hash));
+		__m256i empties = _mm256_cmpeq_epi32(group, _mm256_setzero_si256());
+
+		empty = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(empties));
+		return (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(matches));
+	}
+
+	static uint32_t match_stepped(const uint32_t *hashes, uint32_t first, uint32_t step, uint32_t &empty)
+	{
+		__m256i group = _mm256_loadu_si256((const __m256i *) hashes);
+		__m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int) step));
+		__m256i expected = _mm256_add_epi32(_mm256_set1_epi32((int) first), offsets);
+		__m256i matches = _mm256_cmpeq_epi32(group, expected);
+		__m256i empties = _mm256_cmpeq_epi32(group, _mm256_setzero_si256());
+
+		empty = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(empties));
+		return (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(matches));
+	}
+
+	static uint32_t occupied(const uint32_t *hashes)
+	{
+		// Live entries are exactly the ones that are positive as signed integers.
+		__m256i group = _mm256_loadu_si256((const __m256i *) hashes);
+		__m256i live = _mm256_cmpgt_epi32(group, _mm256_setzero_si256());
+
+		return (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(live));
+	}
+#elif defined(CF_HASH_GROUP_SSE2)
+	static const uint32_t width = 4;
+
+	static uint32_t match(const uint32_t *hashes, uint32_t hash, uint32_t &empty)
+	{
+		__m128i group = _mm_loadu_si128((const __m128i *) hashes);
+		__m128i matches = _mm_cmpeq_epi32(group, _mm_set1_epi32((int) hash));
+		__m128i empties = _mm_cmpeq_epi32(group, _mm_setzero_si128());
+
+		empty = (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(empties));
+		return (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(matches));
+	}
+
+	static uint32_t match_stepped(const uint32_t *hashes, uint32_t first, uint32_t step, uint32_t &empty)
+	{
+		__m128i group = _mm_loadu_si128((const __m128i *) hashes);
+		__m128i expected = _mm_setr_epi32((int) first, (int) (first + step), (int) (first + 2 * step), (int) (first + 3 * step));
+		__m128i matches = _mm_cmpeq_epi32(group, expected);
+		__m128i empties = _mm_cmpeq_epi32(group, _mm_setzero_si128());
+
+		empty = (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(empties));
+		return (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(matches));
+	}
+
+	static uint32_t occupied(const uint32_t *hashes)
+	{
+		// Live entries are exactly the ones that are positive as signed integers.
+		__m128i group = _mm_loadu_si128((const __m128i *) hashes);
+		__m128i live = _mm_cmpgt_epi32(group, _mm_setzero_si128());
+
+		return (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(live));
+	}
+#elif defined(CF_HASH_GROUP_NEON)
+	static const uint32_t width = 4;
+
+	static uint32_t match(const uint32_t *hashes, uint32_t hash, uint32_t &empty)
+	{
+		const uint32_t bits[4] = { 1, 2, 4, 8 };
+		uint32x4_t lanes = vld1q_u32(bits);
+		uint32x4_t group = vld1q_u32(hashes);
+		uint32x4_t matches = vandq_u32(vceqq_u32(group, vdupq_n_u32(hash)), lanes);
+		uint32x4_t empties = vandq_u32(vceqq_u32(group, vdupq_n_u32(0)), lanes);
+
+		empty = vaddvq_u32(empties);
+		return vaddvq_u32(matches);
+	}
+
+	static uint32_t match_stepped(const uint32_t *hashes, uint32_t first, uint32_t step, uint32_t &empty)
+	{
+		const uint32_t bits[4] = { 1, 2, 4, 8 };
+		const uint32_t offsets[4] = { 0, 1, 2, 3 };
+		uint32x4_t lanes = vld1q_u32(bits);
+		uint32x4_t group = vld1q_u32(hashes);
+		uint32x4_t expected = vmlaq_n_u32(vdupq_n_u32(first), vld1q_u32(offsets), step);
+		uint32x4_t matches = vandq_u32(vceqq_u32(group, expected), lanes);
+		uint32x4_t empties = vandq_u32(vceqq_u32(group, vdupq_n_u32(0)), lanes);
+
+		empty = vaddvq_u32(empties);
+		return vaddvq_u32(matches);
+	}
+
+	static uint32_t occupied(const uint32_t *hashes)
+	{
+		// Live entries are exactly the ones that are positive as signed integers.
+		const uint32_t bits[4] = { 1, 2, 4, 8 };
+		uint32x4_t lanes = vld1q_u32(bits);
+		int32x4_t group = vreinterpretq_s32_u32(vld1q_u32(hashes));
+		uint32x4_t live = vandq_u32(vcgtq_s32(group, vdupq_n_s32(0)), lanes);
+
+		return vaddvq_u32(live);
+	}
+#else
+	static const uint32_t width = 1;
+
+	static uint32_t match(const uint32_t *hashes, uint32_t hash, uint32_t &empty)
+	{
+		empty = hashes[0] == 0;
+		return hashes[0] == hash;
+	}
+
+	static uint32_t match_stepped(const uint32_t *hashes, uint32_t first, uint32_t, uint32_t &empty)
+	{
+		empty = hashes[0] == 0;
+		return hashes[0] == first;
+	}
+
+	static uint32_t occupied(const uint32_t *hashes)
+	{
+		return (int32_t) hashes[0] > 0;
+	}
+#endif
+
+	/// Hints the CPU to start loading the cache line at `address`.
+	static void prefetch(const void *address)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(address);
+#else
+		(void) address;
+#endif
+	}
+
+	/// The index of the lowest set lane of a non-zero mask.
+	static uint32_t first(uint32_t mask)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return (uint32_t) __builtin_ctz(mask);
+#else
+		uint32_t lane = 0;
+		while (!(mask & 1)) {
+			mask >>= 1;
+			lane++;
+		}
+		return lane;
+#endif
+	}
+
+	/// A mask of all lanes below the lowest set lane of a non-zero mask.
+	static uint32_t below_first(uint32_t mask)
+	{
+		return (mask & (0 - mask)) - 1;
+	}
+};
+
+/// Hash policy that stores the 32 bit hashes provided by the caller. This is the default.
+/// The value 0 marks empty slots and the highest bit marks deleted entries, so 0 gets
+/// mapped to 1 and the highest bit of the caller-provided hashes is ignored.
+struct hash32 {
+	typedef uint32_t hash_type;
+	typedef uint32_t slot_type;
+
+	static const uint32_t snapshot_id = 1;
+
+	static const bool stores_hash = true;
+	static const bool stores_distance = false;
+	static const uint32_t max_distance = 0xFFFFFFFF;
+	static const uint32_t group_width = hash_group::width;
+
+	static const slot_type EMPTY_HASH = 0;
+	static const slot_type DELETED_HASH_BIT = (slot_type) 1 << 31;
+
+	// We want only hashes != 0 since we use that for detecting empty
+	// entries.
+	// The leftmost bit indicates that the entry was deleted in the past.
+	// We can't use just a "deleted value" because otherwise we lose information
+	// about the previous probe distance
+	static hash_type normalize(hash_type hash)
+	{
+		if (hash == EMPTY_HASH) {
+			hash = EMPTY_HASH + 1;
+		} else if (hash & DELETED_HASH_BIT) {
+			hash &= ~DELETED_HASH_BIT;
+		}
+
+		return hash;
+	}
+
+	static slot_type make(hash_type hash, uint32_t)
+	{
+		return hash;
+	}
+
+	static bool is_empty(slot_type slot)
+	{
+		return slot == EMPTY_HASH;
+	}
+
+	static bool is_deleted(slot_type slot)
+	{
+		return slot & DELETED_HASH_BIT;
+	}
+
+	static slot_type mark_deleted(slot_type slot)
+	{
+		return slot | DELETED_HASH_BIT;
+	}
+
+	static hash_type hash(slot_type slot)
+	{
+		return slot & ~DELETED_HASH_BIT;
+	}
+
+	static uint32_t distance(slot_type)
+	{
+		return 0;
+	}
+
+	static slot_type with_distance(slot_type slot, uint32_t)
+	{
+		return slot;
+	}
+
+	static uint32_t match(const slot_type *slots, hash_type hash, uint32_t, uint32_t &empty)
+	{
+		return hash_group::match(slots, hash, empty);
+	}
+
+	static uint32_t occupied(const slot_type *slots)
+	{
+		return hash_group::occupied(slots);
+	}
+};
+
+/// Hash policy that stores 64 bit hashes, for tables that are too big for 32 bit hashes
+/// to spread the entries well. Works like `hash32` otherwise.
+struct hash64 {
+	typedef uint64_t hash_type;
+	typedef uint64_t slot_type;
+
+	static const uint32_t snapshot_id = 2;
+
+	static const bool stores_hash = true;
+	static const bool stores_distance = false;
+	static const uint32_t max_distance = 0xFFFFFFFF;
+#if defined(CF_HASH_GROUP_AVX2)
+	static const uint32_t group_width = 4;
+#else
+	static const uint32_t group_width = 1;
+#endif
+
+	static const slot_type EMPTY_HASH = 0;
+	static const slot_type DELETED_HASH_BIT = (slot_type) 1 << 63;
+
+	static hash_type normalize(hash_type hash)
+	{
+		if (hash == EMPTY_HASH) {
+			hash = EMPTY_HASH + 1;
+		} else if (hash & DELETED_HASH_BIT) {
+			hash &= ~DELETED_HASH_BIT;
+		}
+
+		return hash;
+	}
+
+	static slot_type make(hash_type hash, uint32_t)
+	{
+		return hash;
+	}
+
+	static bool is_empty(slot_type slot)
+	{
+		return slot == EMPTY_HASH;
+	}
+
+	static bool is_deleted(slot_type slot)
+	{
+		return slot & DELETED_HASH_BIT;
+	}
+
+	static slot_type mark_deleted(slot_type slot)
+	{
+		return slot | DELETED_HASH_BIT;
+	}
+
+	static hash_type hash(slot_type slot)
+	{
+		return slot & ~DELETED_HASH_BIT;
+	}
+
+	static uint32_t distance(slot_type)
+	{
+		return 0;
+	}
+
+	static slot_type with_distance(slot_type slot, uint32_t)
+	{
+		return slot;
+	}
+
+	static uint32_t match(const slot_type *slots, hash_type hash, uint32_t, uint32_t &empty)
+	{
+#if defined(CF_HASH_GROUP_AVX2)
+		__m256i group = _mm256_loadu_si256((const __m256i *) slots);
+		__m256i matches = _mm256_cmpeq_epi64(group, _mm256_set1_epi64x((long long) hash));
+		__m256i empties = _mm256_cmpeq_epi64(group, _mm256_setzero_si256());
+
+		empty = (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(empties));
+		return (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(matches));
+#else
+		empty = slots[0] == EMPTY_HASH;
+		return slots[0] == hash;
+#endif
+	}
+
+	static uint32_t occupied(const slot_type *slots)
+	{
+#if defined(CF_HASH_GROUP_AVX2)
+		__m256i group = _mm256_loadu_si256((const __m256i *) slots);
+		__m256i live = _mm256_cmpgt_epi64(group, _mm256_setzero_si256());
+
+		return (uint32_t) _mm256_movemask_pd(_mm256_castsi256_pd(live));
+#else
+		return (int64_t) slots[0] > 0;
+#endif
+	}
+};
+
+/// Hash policy that packs the probe distance into the upper bits of a 32 bit slot,
+/// so probing never has to calculate the ideal position of the entries it walks over.
+/// The lowest 24 bits hold the caller-provided hash folded to 24 bits, the next 7 bits
+/// the probe distance + 1 and the highest bit marks deleted entries.
+/// Since only 24 bits of the hash are kept, tables with more than 2^24 slots don't
+/// spread the entries any better. Probe distances are limited to `max_distance`,
+/// inserts that would need a longer probe distance are discarded.
+struct hash24_distance {
+	typedef uint32_t hash_type;
+	typedef uint32_t slot_type;
+
+	static const uint32_t snapshot_id = 3;
+
+	static const bool stores_hash = true;
+	static const bool stores_distance = true;
+	static const uint32_t max_distance = 126;
+	static const uint32_t group_width = hash_group::width;
+
+	static const slot_type EMPTY_HASH = 0;
+	static const slot_type DELETED_HASH_BIT = (slot_type) 1 << 31;
+	static const slot_type HASH_MASK = 0xFFFFFF;
+	static const uint32_t DISTANCE_SHIFT = 24;
+
+	static hash_type normalize(hash_type hash)
+	{
+		return (hash ^ (hash >> DISTANCE_SHIFT)) & HASH_MASK;
+	}
+
+	static slot_type make(hash_type hash, uint32_t distance)
+	{
+		return hash | ((distance + 1) << DISTANCE_SHIFT);
+	}
+
+	static bool is_empty(slot_type slot)
+	{
+		return slot == EMPTY_HASH;
+	}
+
+	static bool is_deleted(slot_type slot)
+	{
+		return slot & DELETED_HASH_BIT;
+	}
+
+	static slot_type mark_deleted(slot_type slot)
+	{
+		return slot | DELETED_HASH_BIT;
+	}
+
+	static hash_type hash(slot_type slot)
+	{
+		return slot & HASH_MASK;
+	}
+
+	static uint32_t distance(slot_type slot)
+	{
+		return ((slot & ~DELETED_HASH_BIT) >> DISTANCE_SHIFT) - 1;
+	}
+
+	static slot_type with_distance(slot_type slot, uint32_t distance)
+	{
+		return (slot & (DELETED_HASH_BIT | HASH_MASK)) | ((distance + 1) << DISTANCE_SHIFT);
+	}
+
+	static uint32_t match(const slot_type *slots, hash_type hash, uint32_t distance, uint32_t &empty)
+	{
+		// Entries of later lanes are one slot further away from the home slot, so
+		// each lane gets compared against the slot it would have at that distance.
+		// Lanes beyond the maximum distance can't hold our entry.
+		uint32_t valid = distance + group_width > max_distance + 1
+			? (1u << (max_distance + 1 - distance)) - 1
+			: (1u << group_width) - 1;
+
+		return hash_group::match_stepped(slots, make(hash, distance), 1u << DISTANCE_SHIFT, empty) & valid;
+	}
+
+	static uint32_t occupied(const slot_type *slots)
+	{
+		return hash_group::occupied(slots);
+	}
+};
+
+/// Compact hash policy that stores a 1 byte fingerprint of the 32 bit hash together
+/// with the probe distance in 2 bytes per slot, so a lot more slots fit in a cache line.
+/// The full hash is not stored, so containers using this policy can only be copied by
+/// providing a function that hashes the keys again.
+/// Probe distances are limited to `max_distance`, inserts that would need a longer
+/// probe distance are discarded.
+struct fingerprint8 {
+	typedef uint32_t hash_type;
+	typedef uint16_t slot_type;
+
+	static const uint32_t snapshot_id = 4;
+
+	static const bool stores_hash = false;
+	static const bool stores_distance = true;
+	static const uint32_t max_distance = 126;
+#if defined(CF_HASH_GROUP_SSE2) || defined(CF_HASH_GROUP_AVX2) || defined(CF_HASH_GROUP_NEON)
+	static const uint32_t group_width = 8;
+#else
+	static const uint32_t group_width = 1;
+#endif
+
+	// The lowest 7 bits hold the probe distance + 1, so an empty slot is 0.
+	// The next 8 bits hold the fingerprint, the highest bit marks deleted entries.
+	static const slot_type EMPTY_HASH = 0;
+	static const slot_type DELETED_HASH_BIT = 0x8000;
+	static const slot_type DISTANCE_MASK = 0x7F;
+
+	static hash_type normalize(hash_type hash)
+	{
+		return hash;
+	}
+
+	static slot_type make(hash_type hash, uint32_t distance)
+	{
+		return (slot_type) (((hash >> 24) << 7) | (distance + 1));
+	}
+
+	static bool is_empty(slot_type slot)
+	{
+		return slot == EMPTY_HASH;
+	}
+
+	static bool is_deleted(slot_type slot)
+	{
+		return slot & DELETED_HASH_BIT;
+	}
+
+	static slot_type mark_deleted(slot_type slot)
+	{
+		return slot | DELETED_HASH_BIT;
+	}
+
+	static hash_type hash(slot_type)
+	{
+		return 0;
+	}
+
+	static uint32_t distance(slot_type slot)
+	{
+		return (slot & DISTANCE_MASK) - 1;
+	}
+
+	static slot_type with_distance(slot_type slot, uint32_t distance)
+	{
+		return (slot_type) ((slot & ~DISTANCE_MASK) | (distance + 1));
+	}
+
+	static uint32_t match(const slot_type *slots, hash_type hash, uint32_t distance, uint32_t &empty)
+	{
+		// Entries of later lanes are one slot further away from the home slot, so
+		// each lane gets compared against the slot it would have at that distance.
+		// Lanes beyond the maximum distance can't hold our entry.
+		uint32_t valid = distance + group_width > max_distance + 1
+			? (1u << (max_distance + 1 - distance)) - 1
+			: (1u << group_width) - 1;
+#if defined(CF_HASH_GROUP_SSE2) || defined(CF_HASH_GROUP_AVX2)
+		__m128i group = _mm_loadu_si128((const __m128i *) slots);
+		__m128i expected = _mm_add_epi16(_mm_set1_epi16((short) make(hash, distance)), _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7));
+		__m128i matches = _mm_cmpeq_epi16(group, expected);
+		__m128i empties = _mm_cmpeq_epi16(group, _mm_setzero_si128());
+
+		empty = (uint32_t) _mm_movemask_epi8(_mm_packs_epi16(empties, _mm_setzero_si128()));
+		return (uint32_t) _mm_movemask_epi8(_mm_packs_epi16(matches, _mm_setzero_si128())) & valid;
+#elif defined(CF_HASH_GROUP_NEON)
+		const uint16_t bits[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+		const uint16_t offsets[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+		uint16x8_t lanes = vld1q_u16(bits);
+		uint16x8_t group = vld1q_u16(slots);
+		uint16x8_t expected = vaddq_u16(vdupq_n_u16(make(hash, distance)), vld1q_u16(offsets));
+		uint16x8_t matches = vandq_u16(vceqq_u16(group, expected), lanes);
+		uint16x8_t empties = vandq_u16(vceqq_u16(group, vdupq_n_u16(0)), lanes);
+
+		empty = vaddvq_u16(empties);
+		return vaddvq_u16(matches) & valid;
+#else
+		empty = slots[0] == EMPTY_HASH;
+		return (slots[0] == make(hash, distance)) & valid;
+#endif
+	}
+
+	static uint32_t occupied(const slot_type *slots)
+	{
+#if defined(CF_HASH_GROUP_SSE2) || defined(CF_HASH_GROUP_AVX2)
+		__m128i group = _mm_loadu_si128((const __m128i *) slots);
+		__m128i live = _mm_cmpgt_epi16(group, _mm_setzero_si128());
+
+		return (uint32_t) _mm_movemask_epi8(_mm_packs_epi16(live, _mm_setzero_si128()));
+#elif defined(CF_HASH_GROUP_NEON)
+		const uint16_t bits[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+		uint16x8_t lanes = vld1q_u16(bits);
+		int16x8_t group = vreinterpretq_s16_u16(vld1q_u16(slots));
+		uint16x8_t live = vandq_u16(vcgtq_s16(group, vdupq_n_s16(0)), lanes);
+
+		return vaddvq_u16(live);
+#else
+		return (int16_t) slots[0] > 0;
+#endif
+	}
+};
+
+/// Layout policy that stores all hashes, all keys and all values in three separate
+/// regions of the buffer (Struct-of-Arrays). Probes only touch the hashes region and
+/// iterating over keys or values streams through contiguous memory. This is the default.
+struct layout_soa {
+	static const uint32_t snapshot_id = 1;
+
+	template <typename TSlot, typename TKey, typename TValue>
+	struct layout {
+		/// Whether the hashes of neighbouring slots are next to each other in memory,
+		/// which lets probes compare a whole group of them at once.
+		static const bool contiguous_slots = true;
+
+		/// The alignment of the buffer that lines every region up with cache lines and
+		/// the alignment of its elements.
+		static constexpr size_t alignment()
+		{
+			return region_alignment<TSlot>() > region_alignment<TKey>()
+			       ? (region_alignment<TSlot>() > region_alignment<TValue>() ? region_alignment<TSlot>() : region_alignment<TValue>())
+			       : (region_alignment<TKey>() > region_alignment<TValue>() ? region_alignment<TKey>() : region_alignment<TValue>());
+		}
+
+		static constexpr size_t keys_offset(size_t capacity)
+		{
+			return region_start<TKey>(sizeof(TSlot) * capacity);
+		}
+
+		static constexpr size_t values_offset(size_t capacity)
+		{
+			return region_start<TValue>(keys_offset(capacity) + sizeof(TKey) * capacity);
+		}
+
+		static constexpr size_t buffer_size(size_t num_slots)
+		{
+			return values_offset(num_slots) + sizeof(TValue) * num_slots;
+		}
+
+		/// The largest number of slots that fit into the buffer, padding included.
+		static size_t max_slots(size_t buffer_size)
+		{
+			size_t num_slots = buffer_size / (sizeof(TSlot) + sizeof(TKey) + sizeof(TValue));
+
+			while (num_slots > 0 && layout::buffer_size(num_slots) > buffer_size) {
+				num_slots--;
+			}
+
+			return num_slots;
+		}
+
+		/// The pointers `slot()`, `key()` and `value()` work with. Containers compute them
+		/// with `regions_for()` whenever their buffer or capacity changes, instead of
+		/// on every access. The regions never overlap.
+		struct regions {
+			TSlot *__restrict slots;
+			TKey *__restrict keys;
+			TValue *__restrict values;
+		};
+
+		static regions regions_for(uint8_t *buffer, size_t capacity)
+		{
+			regions r;
+			r.slots = (TSlot *) buffer;
+			r.keys = (TKey *) (buffer + keys_offset(capacity));
+			r.values = (TValue *) (buffer + values_offset(capacity));
+			return r;
+		}
+
+		static TSlot *slot(const regions &r, size_t i)
+		{
+			return r.slots + i;
+		}
+
+		static TKey *key(const regions &r, size_t i)
+		{
+			return r.keys + i;
+		}
+
+		static TValue *value(const regions &r, size_t i)
+		{
+			return r.values + i;
+		}
+
+		/// Moves the contents of the slots from where they are with `old_capacity` to
+		/// where they belong with `new_capacity`.
+		static void grow(uint8_t *buffer, size_t old_capacity, size_t new_capacity)
+		{
+			// The regions start further back in the bigger buffer, move the values
+			// first so they don't get overwritten by the keys.
+			_move_bytes_back(buffer + values_offset(new_capacity),
+			                 buffer + values_offset(old_capacity),
+			                 sizeof(TValue) * old_capacity);
+			_move_bytes_back(buffer + keys_offset(new_capacity),
+			                 buffer + keys_offset(old_capacity),
+			                 sizeof(TKey) * old_capacity);
+		}
+
+	private:
+		// Copies `size` bytes from `src` to `dst`, starting at the end. This is safe for
+		// overlapping ranges as long as `dst` comes after `src`.
+		static void _move_bytes_back(uint8_t *dst, const uint8_t *src, size_t size)
+		{
+			while (size > 0) {
+				size--;
+				dst[size] = src[size];
+			}
+		}
+	};
+};
+
+/// The number of entries of a `layout_bucketed` bucket and where the keys and values
+/// start inside of it.
+template <typename TSlot, typename TKey, typename TValue, size_t BucketSize>
+struct bucket_shape {
+	static constexpr size_t align(size_t offset, size_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	static constexpr size_t keys_offset(size_t entries)
+	{
+		return align(sizeof(TSlot) * entries, alignof(TKey));
+	}
+
+	static constexpr size_t values_offset(size_t entries)
+	{
+		return align(keys_offset(entries) + sizeof(TKey) * entries, alignof(TValue));
+	}
+
+	static constexpr size_t bytes(size_t entries)
+	{
+		return values_offset(entries) + sizeof(TValue) * entries;
+	}
+
+	static constexpr size_t entries_from(size_t entries)
+	{
+		return bytes(entries + 1) <= BucketSize ? entries_from(entries + 1) : entries;
+	}
+
+	static constexpr size_t max_align()
+	{
+		return alignof(TSlot) > alignof(TKey)
+		       ? (alignof(TSlot) > alignof(TValue) ? alignof(TSlot) : alignof(TValue))
+		       : (alignof(TKey) > alignof(TValue) ? alignof(TKey) : alignof(TValue));
+	}
+
+	/// Entries per bucket, at least one even if a single entry is bigger than a bucket.
+	static const size_t ENTRIES = entries_from(1);
+
+	static const size_t KEYS_OFFSET = keys_offset(ENTRIES);
+
+	static const size_t VALUES_OFFSET = values_offset(ENTRIES);
+
+	/// The distance between two buckets. Buckets that fit into `BucketSize` bytes are
+	/// padded to it, so they line up with cache lines if the buffer does.
+	static const size_t STRIDE = bytes(ENTRIES) <= BucketSize ? BucketSize : align(bytes(ENTRIES), max_align());
+};
+
+/// Layout policy that interleaves hashes, keys and values in buckets of `BucketSize`
+/// bytes. Every bucket holds the hashes, keys and values of a few neighbouring slots
+/// (for example 5 for `uint32_t` keys and values), so a probe and the key comparison
+/// and value access of a hit usually touch a single cache line instead of three.
+/// Probes compare the hashes one at a time, and iteration has to skip over keys and
+/// values, so the SoA layout stays better for iteration heavy workloads and big values.
+template <size_t BucketSize = 64>
+struct layout_bucketed {
+	static const uint32_t snapshot_id = (2 << 16) | BucketSize;
+
+	template <typename TSlot, typename TKey, typename TValue>
+	struct layout {
+	private:
+		typedef bucket_shape<TSlot, TKey, TValue, BucketSize> shape;
+
+	public:
+		static const bool contiguous_slots = false;
+
+		/// Buckets line up with cache lines if the buffer starts on one.
+		static constexpr size_t alignment()
+		{
+			return shape::STRIDE % CF_CACHE_LINE_SIZE == 0 ? CF_CACHE_LINE_SIZE : shape::max_align();
+		}
+
+		static constexpr size_t buffer_size(size_t num_slots)
+		{
+			return (num_slots + shape::ENTRIES - 1) / shape::ENTRIES * shape::STRIDE;
+		}
+
+		static size_t max_slots(size_t buffer_size)
+		{
+			return buffer_size / shape::STRIDE * shape::ENTRIES;
+		}
+
+		/// Buckets don't depend on the capacity, so the start of the buffer is all that's needed.
+		struct regions {
+			uint8_t *buffer;
+		};
+
+		static regions regions_for(uint8_t *buffer, size_t)
+		{
+			regions r;
+			r.buffer = buffer;
+			return r;
+		}
+
+		static TSlot *slot(const regions &r, size_t i)
+		{
+			return (TSlot *) (r.buffer + i / shape::ENTRIES * shape::STRIDE) + i % shape::ENTRIES;
+		}
+
+		static TKey *key(const regions &r, size_t i)
+		{
+			return (TKey *) (r.buffer + i / shape::ENTRIES * shape::STRIDE + shape::KEYS_OFFSET) + i % shape::ENTRIES;
+		}
+
+		static TValue *value(const regions &r, size_t i)
+		{
+			return (TValue *) (r.buffer + i / shape::ENTRIES * shape::STRIDE + shape::VALUES_OFFSET) + i % shape::ENTRIES;
+		}
+
+		/// The position of a slot doesn't depend on the capacity, so nothing moves.
+		static void grow(uint8_t *, size_t, size_t)
+		{
+		}
+	};
+};
+
+/// Equality policy that compares keys with `operator==`. This is the default.
+/// An equality policy provides `equal(stored, probe)` for the key type itself and for
+/// every other type keys should be looked up with, for example a comparison that uses
+/// `memcmp()` or checks a precomputed prefix first. Lookups with a type that is not the
+/// key type are only available if `equal()` accepts that combination.
+struct equal_operator {
+	template <typename TStored, typename TProbe>
+	static auto equal(const TStored &stored, const TProbe &probe) -> decltype(stored == probe)
+	{
+		return stored == probe;
+	}
+};
+
+/// Names `TResult`, but only if `TCheck` is a valid type. Used to take functions out of
+/// overload resolution when an expression in `TCheck` doesn't compile.
+template <typename TResult, typename TCheck>
+struct result_if_valid {
+	typedef TResult type;
+};
+
+/// Statistics about the slots of a `cf::hashmap` or `cf::hashset`, see `stats()`.
+struct hash_stats {
+
+	/// The number of buckets of `probe_distance_histogram`.
+	static const size_t HISTOGRAM_SIZE = 32;
+
+	size_t capacity;
+
+	size_t num_elements;
+
+	/// Slots of removed entries that still take part in probe chains.
+	size_t num_tombstones;
+
+	/// Elements per slot, like `load_factor()`.
+	float load_factor;
+
+	/// Elements and tombstones per slot. Lookups of missing elements walk over both,
+	/// so this is the load factor they actually see.
+	float effective_load_factor;
+
+	uint32_t max_probe_distance;
+
+	float mean_probe_distance;
+
+	/// The most slots in a row that aren't empty, tombstones included. A lookup that
+	/// misses can't stop before the end of the run it starts in.
+	size_t longest_run;
+
+	/// How many elements are `i` slots away from their home slot. The last bucket also
+	/// counts all elements that are further away.
+	size_t probe_distance_histogram[HISTOGRAM_SIZE];
+
+	/// The number of lookups and the slots they inspected since the container was
+	/// created or the counters were reset. Removals and other operations that search for
+	/// an existing element count as lookups too. Only counted if the traits set
+	/// `count_probes`, otherwise both are 0.
+	uint64_t num_lookups;
+
+	uint64_t num_lookup_probes;
+};
+
+/// The lookup counters of `cf::hashmap` and `cf::hashset` when `hash_traits::count_probes`
+/// is true. They are plain integers, so lookups from several threads at once race on them.
+template <bool Enabled>
+struct probe_counters {
+	mutable uint64_t m_num_lookups;
+	mutable uint64_t m_num_lookup_probes;
+
+	// Records a lookup that inspected `probes` slots.
+	void _count_lookup(uint32_t probes) const
+	{
+		m_num_lookups++;
+		m_num_lookup_probes += probes;
+	}
+
+	void _reset_probe_counters()
+	{
+		m_num_lookups = 0;
+		m_num_lookup_probes = 0;
+	}
+
+	void _read_probe_counters(hash_stats &stats) const
+	{
+		stats.num_lookups = m_num_lookups;
+		stats.num_lookup_probes = m_num_lookup_probes;
+	}
+};
+
+/// Counts nothing. The containers derive from the counters, so this takes no space.
+template <>
+struct probe_counters<false> {
+	void _count_lookup(uint32_t) const
+	{
+	}
+
+	void _reset_probe_counters()
+	{
+	}
+
+	void _read_probe_counters(hash_stats &) const
+	{
+	}
+};
+
+/// Mixes the bits of a 32 bit integer so every input bit affects every output bit.
+/// This is a bijection, so different integers never get the same hash. Good for
+/// sequential ids, which would otherwise all end up in neighbouring slots.
+inline uint32_t hash_mix32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/// Mixes the bits of a 64 bit integer, the 64 bit version of `hash_mix32()` (the
+/// finalizer of splitmix64).
+inline uint64_t hash_mix64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+/// A byte string hash modeled after wyhash (final version 4, by Wang Yi, public
+/// domain), used by `hash_bytes()`. Strings of up to 16 bytes take two multiplications,
+/// longer ones get consumed 48 bytes at a time. It's meant for hash tables, the results
+/// aren't guaranteed to match other wyhash implementations bit for bit.
+struct wyhash {
+
+	/// Multiplies `a` and `b`, `a` becomes the lower and `b` the upper half of the result.
+	static void multiply(uint64_t &a, uint64_t &b)
+	{
+#if defined(__SIZEOF_INT128__)
+		__uint128_t r = (__uint128_t) a * b;
+		a = (uint64_t) r;
+		b = (uint64_t) (r >> 64);
+#else
+		uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t) a, lb = (uint32_t) b;
+		uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+		uint64_t t = rl + (rm0 << 32);
+		uint64_t c = t < rl;
+		uint64_t lo = t + (rm1 << 32);
+		c += lo < t;
+		a = lo;
+		b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+	}
+
+	static uint64_t mix(uint64_t a, uint64_t b)
+	{
+		multiply(a, b);
+		return a ^ b;
+	}
+
+	static uint64_t read64(const uint8_t *p)
+	{
+		uint64_t v;
+		__builtin_memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static uint64_t read32(const uint8_t *p)
+	{
+		uint32_t v;
+		__builtin_memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static uint64_t hash(const void *data, size_t size, uint64_t seed)
+	{
+		static const uint64_t SECRET[4] = {
+			0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+		};
+
+		const uint8_t *p = (const uint8_t *) data;
+		uint64_t a;
+		uint64_t b;
+
+		seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+
+		if (size <= 16) {
+			if (size >= 4) {
+				a = (read32(p) << 32) | read32(p + ((size >> 3) << 2));
+				b = (read32(p + size - 4) << 32) | read32(p + size - 4 - ((size >> 3) << 2));
+			} else if (size > 0) {
+				a = ((uint64_t) p[0] << 16) | ((uint64_t) p[size >> 1] << 8) | p[size - 1];
+				b = 0;
+			} else {
+				a = 0;
+				b = 0;
+			}
+		} else {
+			size_t i = size;
+
+			if (i > 48) {
+				uint64_t seed1 = seed;
+				uint64_t seed2 = seed;
+
+				do {
+					seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+					seed1 = mix(read64(p + 16) ^ SECRET[2], read64(p + 24) ^ seed1);
+					seed2 = mix(read64(p + 32) ^ SECRET[3], read64(p + 40) ^ seed2);
+					p += 48;
+					i -= 48;
+				} while (i > 48);
+
+				seed ^= seed1 ^ seed2;
+			}
+
+			while (i > 16) {
+				seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+				i -= 16;
+				p += 16;
+			}
+
+			a = read64(p + i - 16);
+			b = read64(p + i - 8);
+		}
+
+		a ^= SECRET[1];
+		b ^= seed;
+		multiply(a, b);
+
+		return mix(a ^ SECRET[0] ^ size, b ^ SECRET[1]);
+	}
+};
+
+/// Hashes `size` bytes with `wyhash`. The bytes are read in the byte order of the
+/// machine, so the hashes differ between little and big endian machines.
+inline uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0)
+{
+	return wyhash::hash(data, size, seed);
+}
+
+/// Hasher policy that is used by the overloads of `cf::hashmap` and `cf::hashset` that
+/// hash keys themselves. A hasher policy provides `hash(key)` returning 64 bits, the
+/// containers fold them to the width of their hash policy.
+/// This one hashes integers, enums and pointers with `hash_mix64()`, and everything
+/// with `data()` and `size()` (like `std::string` or `std::string_view`) with
+/// `hash_bytes()` over its contents. For other key types derive from `hash_traits` and
+/// set `hasher_policy` to a struct with a `hash()` for them.
+struct hasher {
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint64_t>::type hash(const T &key)
+	{
+		return hash_mix64((uint64_t) key);
+	}
+
+	template <typename T>
+	static uint64_t hash(T *const &key)
+	{
+		return hash_mix64((uint64_t) (uintptr_t) key);
+	}
+
+	template <typename T>
+	static auto hash(const T &key) -> decltype((void) key.data(), (void) key.size(), uint64_t())
+	{
+		return hash_bytes(key.data(), key.size() * sizeof(*key.data()));
+	}
+};
+
+/// Folds the 64 bit result of a hasher policy into a hash of type `THash`.
+template <typename THash>
+inline THash fold_hash(uint64_t hash)
+{
+	return sizeof(THash) >= sizeof(uint64_t) ? (THash) hash : (THash) (hash ^ (hash >> 32));
+}
+
+/// The policies used by `cf::hashmap` and `cf::hashset`. To use different policies,
+/// derive from this struct and redefine the members that should change, then pass
+/// the new struct as the last template argument of the container.
+struct hash_traits {
+	typedef capacity_modulo capacity_policy;
+
+	/// How hashes are stored in the hashes region, see `hash32`, `hash64`,
+	/// `hash24_distance` and `fingerprint8`.
+	typedef hash32 hash_policy;
+
+	/// How the slots are arranged in the buffer of a `cf::hashmap`, see `layout_soa`
+	/// and `layout_bucketed`. `cf::hashset` always uses separate regions.
+	typedef layout_soa layout_policy;
+
+	/// When false, removed entries are only marked as deleted and keep occupying their
+	/// slot until the container is relocated with `copy()`.
+	/// When true, removing an entry shifts the following entries of its probe chain back
+	/// by one slot, so no tombstones are left behind and lookups only ever walk over
+	/// live entries.
+	static const bool backward_shift_deletion = false;
+
+	/// How many entries ahead the batched lookups prefetch the home slots for.
+	static const size_t prefetch_distance = 8;
+
+	/// How many slots of the old table every operation on an `incremental_hashmap`
+	/// migrates while a resize is in progress.
+	static const size_t migration_slots = 16;
+
+	/// How keys (and the values of a `cf::hashset`) are compared, see `equal_operator`.
+	typedef equal_operator equality_policy;
+
+	/// How the overloads that take no hash compute it from the key, see `hasher`.
+	typedef hasher hasher_policy;
+
+	/// When true, lookups count how many slots they inspect and `stats()` reports the
+	/// totals, see `probe_counters`. Meant for single threaded tuning builds.
+	static const bool count_probes = false;
+};
+
+/// Traits that use power-of-two capacities and mask based slot indexing.
+struct hash_traits_pow2 : hash_traits {
+	typedef capacity_pow2 capacity_policy;
+};
+
+/// Traits that store 64 bit hashes.
+struct hash_traits_64 : hash_traits {
+	typedef hash64 hash_policy;
+};
+
+/// Traits that store the probe distance next to a 24 bit hash.
+struct hash_traits_distance : hash_traits {
+	typedef hash24_distance hash_policy;
+};
+
+/// Traits that store 1 byte fingerprints and probe distances instead of full hashes.
+struct hash_traits_fingerprint : hash_traits {
+	typedef fingerprint8 hash_policy;
+};
+
+/// Traits that use backward shift deletion instead of tombstones.
+struct hash_traits_backward_shift : hash_traits {
+	static const bool backward_shift_deletion = true;
+};
+
+/// Traits that interleave hashes, keys and values in cache line sized buckets.
+struct hash_traits_bucketed : hash_traits {
+	typedef layout_bucketed<> layout_policy;
+};
+
+/// Traits like `TTraits`, but with a capacity fixed to `N` slots. These are the traits
+/// of `cf::static_hashmap` and `cf::static_hashset`.
+template <typename TTraits, size_t N>
+struct hash_traits_fixed : TTraits {
+	typedef capacity_fixed<N> capacity_policy;
+};
+
+}
+
+#endif
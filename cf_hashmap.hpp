@@ -4,325 +4,1758 @@
 
 ///
 /// This is a single-header library that provides a cache-friendly hash map
-/// implementation that uses open addressing with robin hood hashing.
+/// implementation that uses open addressing with robin hood hashing. Its policies
+/// and hash helpers come from cf_hash_policies.hpp, which is shared with cf_hashset.hpp.
 ///
 #ifndef CF_HASHMAP_HPP
 #define CF_HASHMAP_HPP
 
 #include <stdint.h>
 #include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "cf_hash_policies.hpp"
 
 namespace cf {
 
+/// Calculates the size of a buffer for a hashmap with the default traits that can hold
+/// `num_elements` elements, including the padding between the regions.
 #define CF_HASHMAP_GET_BUFFER_SIZE(key_type, value_type, num_elements) \
-	((sizeof(uint32_t) + sizeof(key_type) + sizeof(value_type)) * num_elements)
+	(cf::hashmap<key_type, value_type>::buffer_size(num_elements))
+
+/// Calculates the size of a buffer for a hashmap using the `capacity_pow2` policy
+/// that can hold at least `num_elements` elements.
+#define CF_HASHMAP_GET_BUFFER_SIZE_POW2(key_type, value_type, num_elements) \
+	CF_HASHMAP_GET_BUFFER_SIZE(key_type, value_type, cf::pow2_ceil(num_elements))
+
+/// Calculates the size of a buffer for a hashmap with the given traits that can hold
+/// at least `num_elements` elements.
+#define CF_HASHMAP_GET_BUFFER_SIZE_TRAITS(traits, key_type, value_type, num_elements) \
+	(cf::hashmap<key_type, value_type, traits>::buffer_size(num_elements))
+
+/// The header that `hashmap::save_header()` writes in front of a table, so the buffer of
+/// a map can be stored in a file and used again with `hashmap::attach()`, without
+/// rebuilding it. The policies are identified by their `snapshot_id`, custom policies
+/// need one as well to be used with snapshots.
+/// All fields use the byte order of the machine that saved the snapshot, attaching it on
+/// a machine with a different byte order fails.
+struct hashmap_snapshot_header {
+	/// "CFHM" in the byte order of the machine that saved the snapshot.
+	static const uint32_t MAGIC = 0x4d484643;
+
+	/// Gets bumped whenever the way a table is stored in its buffer changes.
+	static const uint32_t VERSION = 2;
+
+	uint32_t magic;
+	uint32_t version;
+
+	uint64_t capacity;
+	uint64_t num_elements;
+
+	/// The number of bytes of the table that follow the header.
+	uint64_t table_size;
+
+	uint32_t key_size;
+	uint32_t key_align;
+	uint32_t value_size;
+	uint32_t value_align;
+
+	uint32_t capacity_policy;
+	uint32_t hash_policy;
+	uint32_t layout_policy;
+
+	uint32_t reserved;
+};
+
+template <typename TKey, typename TValue, typename TTraits>
+struct incremental_hashmap;
+
+template <typename TKey, typename TValue, size_t NumShards, typename TTraits>
+struct sharded_hashmap;
+
+template <typename TKey, typename TValue, typename TTraits>
+struct concurrent_hashmap;
 
 /// A hashmap type that uses open addressing with robinhood hashing.
 /// The hashmap uses 3 different regions of memory: hashes, keys and values.
 /// Those regions are located next to each other in a buffer in a Struct-of-Arrays
-/// kind of fashion.
-/// This hashmap doesn't perform any hashing itself, so the the user has to provide
-/// the hash values. The keys have to be POD types. Comparision of keys to
-/// resolve hash collisions uses operator==, so this might need to be implemented
-/// if the key type is not a primitive type.
-template <typename TKey, typename TValue>
-struct hashmap {
+/// kind of fashion. Every region starts on a cache line, so keys and values are aligned
+/// as long as the buffer starts on a cache line too.
+/// The user provides the hash values, or uses the overloads without a hash that hash
+/// keys with the `hasher_policy` of the traits. Comparision of keys to resolve hash collisions uses operator==,
+/// so this might need to be implemented if the key type is not a primitive type.
+/// Keys and values don't have to be POD types. Entries are constructed in their slots
+/// and moved when robin hood hashing or removals displace them, they get destroyed when
+/// they are removed or the map is cleared with `clear()`. `grow_in_place()` is only
+/// available for trivially copyable keys and values.
+/// The `TTraits` parameter selects the policies used by the map, see `cf::hash_traits`.
+template <typename TKey, typename TValue, typename TTraits = hash_traits>
+struct hashmap : private probe_counters<TTraits::count_probes> {
 
 private:
+	template <typename, typename, typename>
+	friend struct incremental_hashmap;
+
+	template <typename, typename, size_t, typename>
+	friend struct sharded_hashmap;
+
+	template <typename, typename, typename>
+	friend struct concurrent_hashmap;
+
+	template <typename, typename, size_t, typename>
+	friend struct static_hashmap;
+
+	typedef typename TTraits::capacity_policy capacity_policy;
+	typedef typename TTraits::hash_policy hash_policy;
+	typedef typename hash_policy::slot_type slot_type;
+	typedef typename TTraits::layout_policy::template layout<slot_type, TKey, TValue> layout;
+	typedef typename TTraits::equality_policy equality_policy;
+	typedef typename TTraits::hasher_policy hasher_policy;
+
+	// `TResult` if keys can be compared with a `TK`, otherwise the function using this
+	// drops out of overload resolution. Numbers and pointers that convert to a `TKey` get
+	// converted like before, so literals don't end up being compared as another type.
+	template <typename TK, typename TResult>
+	using _if_comparable = typename result_if_valid<
+		typename std::enable_if<std::is_same<TK, TKey>::value || !(std::is_scalar<TK>::value && std::is_convertible<const TK &, TKey>::value), TResult>::type,
+		decltype(equality_policy::equal(std::declval<const TKey &>(), std::declval<const TK &>()))>::type;
+
 	size_t m_num_elements;
 
 	size_t m_capacity;
 
 	uint8_t *m_buffer;
 
-	static const uint32_t EMPTY_HASH = 0;
-	static const uint32_t DELETED_HASH_BIT = 1 << 31;
+	typename layout::regions m_regions;
 
+	// Swaps by moving, for trivially copyable types this is a plain copy.
 	template <typename T>
 	static void _swap(T &a, T &b)
 	{
-		T tmp = a;
-		a = b;
-		b = tmp;
+		T tmp(static_cast<T &&>(a));
+		a = static_cast<T &&>(b);
+		b = static_cast<T &&>(tmp);
+	}
+
+public:
+
+	/// The type of the hashes the caller provides, depends on the hash policy.
+	typedef typename hash_policy::hash_type hash_type;
+
+private:
+
+	static hash_type _hash(hash_type hash)
+	{
+		return hash_policy::normalize(hash);
 	}
 
-	// We want only hashes != 0 since we use that for detecting empty
-	// entries.
-	// The leftmost bit indicates that the entry was deleted in the past.
-	// We can't use just a "deleted value" because otherwise we lose information
-	// about the previous probe distance
-	static uint32_t _hash(uint32_t hash)
+	// The hash of a key for the overloads that don't take one.
+	static hash_type _hash_key(const TKey &key)
 	{
-		if (hash == EMPTY_HASH) {
-			hash = EMPTY_HASH + 1;
-		} else if (hash & DELETED_HASH_BIT) {
-			hash &= ~DELETED_HASH_BIT;
-		}
+		return fold_hash<hash_type>(hasher_policy::hash(key));
+	}
+
+	slot_type &_slot(size_t pos) const
+	{
+		return *layout::slot(m_regions, pos);
+	}
+
+	TKey &_key(size_t pos) const
+	{
+		return *layout::key(m_regions, pos);
+	}
+
+	TValue &_value(size_t pos) const
+	{
+		return *layout::value(m_regions, pos);
+	}
+
+	// Has to be called whenever the buffer or the capacity changes.
+	void _update_regions()
+	{
+		m_regions = layout::regions_for(m_buffer, m_capacity);
+	}
+
+	inline uint32_t _home(hash_type hash) const
+	{
+		return capacity_policy::index(hash, m_capacity);
+	}
 
-		return hash;
+	inline uint32_t _next(uint32_t pos) const
+	{
+		return capacity_policy::next(pos, m_capacity);
 	}
 
-	uint32_t _get_probe_distance(uint32_t pos, uint32_t hash) const
+	uint32_t _get_probe_distance(uint32_t pos, slot_type slot) const
 	{
-		hash = hash & ~DELETED_HASH_BIT;
+		if (hash_policy::stores_distance) {
+			return hash_policy::distance(slot);
+		}
 
-		uint32_t ideal_pos = hash % m_capacity;
+		uint32_t ideal_pos = _home(hash_policy::hash(slot));
 
-		return pos - ideal_pos;
+		return capacity_policy::distance(pos, ideal_pos, m_capacity);
 	}
 
-	bool _lookup_pos(uint32_t hash, const TKey &key, uint32_t &pos) const
+	template <typename TK>
+	bool _lookup_pos(hash_type hash, const TK &key, uint32_t &pos) const
 	{
-		pos = hash % m_capacity;
+		pos = _home(hash);
 		uint32_t distance = 0;
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		TKey *keys = (TKey *) (m_buffer + m_capacity * sizeof(uint32_t));
+		while (distance < m_capacity && distance <= hash_policy::max_distance) {
 
-		while (distance < m_capacity) {
-			if (hashes[pos] == EMPTY_HASH) {
-				return false;
+			if (!layout::contiguous_slots || pos + hash_policy::group_width > m_capacity) {
+				// Not enough slots left for a whole group before the table wraps
+				// around (or the layout doesn't keep the hashes of a group next to
+				// each other), so take a single step instead.
+				if (hash_policy::is_empty(_slot(pos))) {
+					this->_count_lookup(distance + 1);
+					return false;
+				}
+
+				if (distance > _get_probe_distance(pos, _slot(pos))) {
+					this->_count_lookup(distance + 1);
+					return false;
+				}
+
+				if (_slot(pos) == hash_policy::make(hash, distance) && equality_policy::equal(_key(pos), key)) {
+					this->_count_lookup(distance + 1);
+					return true;
+				}
+
+				pos = _next(pos);
+				distance++;
+				continue;
+			}
+
+			uint32_t empty = 0;
+			uint32_t match = hash_policy::match(&_slot(pos), hash, distance, empty);
+
+			// The chain ends at the first empty slot, matches after it are
+			// part of a different chain.
+			if (empty) {
+				match &= hash_group::below_first(empty);
+			}
+
+			// Only the candidate lanes need to touch the keys region.
+			while (match) {
+				uint32_t lane = hash_group::first(match);
+				if (equality_policy::equal(_key(pos + lane), key)) {
+					this->_count_lookup(distance + lane + 1);
+					pos += lane;
+					return true;
+				}
+				match &= match - 1;
 			}
 
-			if (distance > _get_probe_distance(pos, hashes[pos])) {
+			if (empty) {
+				this->_count_lookup(distance + hash_group::first(empty) + 1);
 				return false;
 			}
 
-			if (hashes[pos] == hash && keys[pos] == key) {
-				return true;
+			// Robin hood ordering: if the last entry of the group is closer to its
+			// ideal position than we would be, our entry can't come after it.
+			uint32_t last = pos + hash_policy::group_width - 1;
+			distance += hash_policy::group_width - 1;
+			if (distance > _get_probe_distance(last, _slot(last))) {
+				this->_count_lookup(distance + 1);
+				return false;
 			}
 
-			pos = (pos + 1) % m_capacity;
+			pos = _next(last);
 			distance++;
 		}
 
+		this->_count_lookup(distance);
 		return false;
 	}
 
-	void insert(uint32_t hash, const TKey &key, const TValue &value)
+	template <typename TK, typename TV>
+	void insert(hash_type hash, TK &&key, TV &&value)
+	{
+		_insert_at(_home(hash), 0, hash, static_cast<TK &&>(key), static_cast<TV &&>(value));
+	}
+
+	// Inserts a new entry with robin hood displacement, starting at `pos` which is
+	// `distance` slots away from the home slot of `hash`. The new entry is constructed
+	// directly in the slot it belongs into, only the entries that get displaced by it
+	// are moved.
+	// Returns false if the entry couldn't be stored.
+	template <typename TK, typename TV>
+	bool _insert_at(uint32_t pos, uint32_t distance, hash_type hash, TK &&key, TV &&value)
 	{
 
 		if (m_num_elements == m_capacity) {
 			// if this is the case then this will just keep trying to
 			// swap stuff around, never terminating.
-			return;
+			return false;
 		}
 
-		uint32_t distance = 0;
-		uint32_t pos = hash % m_capacity;
+		if (hash_policy::max_distance < m_capacity && !_can_insert(pos, distance)) {
+			// some entry would end up further away from its ideal position
+			// than the hash policy can store.
+			return false;
+		}
+
+		// Find the first slot that is empty or holds an entry closer to its home.
+		while (!hash_policy::is_empty(_slot(pos)) && _get_probe_distance(pos, _slot(pos)) >= distance) {
+			pos = _next(pos);
+			distance++;
+		}
 
-		TKey _key = key;
-		TValue _value = value;
+		slot_type slot = hash_policy::make(hash, distance);
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		TKey *keys = (TKey *) (m_buffer + sizeof(uint32_t) * m_capacity);
-		TValue *values = (TValue *) (m_buffer + (sizeof(uint32_t) + sizeof(TKey)) * m_capacity);
+		if (hash_policy::is_empty(_slot(pos)) || hash_policy::is_deleted(_slot(pos))) {
+			// Empty slots and tombstones don't hold constructed entries.
+			_slot(pos) = slot;
+			new (&_key(pos)) TKey(static_cast<TK &&>(key));
+			new (&_value(pos)) TValue(static_cast<TV &&>(value));
+			m_num_elements++;
+			return true;
+		}
+
+		// Take out the entry that was here, it gets moved further to the right.
+		TKey moved_key(static_cast<TKey &&>(_key(pos)));
+		TValue moved_value(static_cast<TValue &&>(_value(pos)));
+		distance = _get_probe_distance(pos, _slot(pos));
+		_swap(slot, _slot(pos));
+
+		_key(pos) = static_cast<TK &&>(key);
+		_value(pos) = static_cast<TV &&>(value);
+
+		pos = _next(pos);
+		distance++;
 
 		while (distance < m_capacity) {
 
 			// An empty slot, put our stuff in there, then we're done!
-			if (hashes[pos] == EMPTY_HASH) {
-				hashes[pos] = hash;
-				keys[pos] = _key;
-				values[pos] = _value;
+			if (hash_policy::is_empty(_slot(pos))) {
+				_slot(pos) = hash_policy::with_distance(slot, distance);
+				new (&_key(pos)) TKey(static_cast<TKey &&>(moved_key));
+				new (&_value(pos)) TValue(static_cast<TValue &&>(moved_value));
 				m_num_elements++;
-				return;
+				return true;
 			}
 
-			uint32_t exiting_distance = _get_probe_distance(pos, hashes[pos]);
+			uint32_t exiting_distance = _get_probe_distance(pos, _slot(pos));
 			if (exiting_distance < distance) {
 				// we found a slot that should be further to the right
 
-				if (hashes[pos] & DELETED_HASH_BIT) {
+				if (hash_policy::is_deleted(_slot(pos))) {
 					// buuuut it was deleted so we can use it
 
-					hashes[pos] = hash;
-					keys[pos] = _key;
-					values[pos] = _value;
+					_slot(pos) = hash_policy::with_distance(slot, distance);
+					new (&_key(pos)) TKey(static_cast<TKey &&>(moved_key));
+					new (&_value(pos)) TValue(static_cast<TValue &&>(moved_value));
 					m_num_elements++;
-					return;
+					return true;
 				}
 
 				// swap out the entry and now operate on the other value
 				// that should be further to the right
-				_swap(hash, hashes[pos]);
-				_swap(_key, keys[pos]);
-				_swap(_value, values[pos]);
+				slot = hash_policy::with_distance(slot, distance);
+				_swap(slot, _slot(pos));
+				_swap(moved_key, _key(pos));
+				_swap(moved_value, _value(pos));
 				distance = exiting_distance;
 			}
 
-			pos = (pos + 1) % m_capacity;
+			pos = _next(pos);
 			distance++;
 		}
 
+		return false;
 	}
 
-public:
+	// Walks the probe chain like an insert would, without modifying anything, to find
+	// out if all displaced entries stay within the maximum probe distance.
+	bool _can_insert(uint32_t pos, uint32_t distance) const
+	{
+		for (size_t i = 0; i < m_capacity; i++) {
+			if (distance > hash_policy::max_distance) {
+				return false;
+			}
 
-	/// An iterator for iterating over key-value pairs. Use `iter_start()` to acquire
-	/// such an iterator. Use `iter_next()` to advance the iteration.
-	struct iter {
-		size_t offset;
-	};
+			if (hash_policy::is_empty(_slot(pos))) {
+				return true;
+			}
 
-	/// This function constructs a new hashmap value.
-	/// The buffer is a chunk of memory that will be used as the storage. It should probably be
-	/// created by using the `CF_HASHMAP_GET_BUFFER_SIZE` macro.
-	/// Don't modify the contents of the buffer after handing it to a hashmap.
-	static hashmap create(size_t buffer_size, void *buffer)
+			uint32_t existing_distance = _get_probe_distance(pos, _slot(pos));
+			if (existing_distance < distance) {
+				if (hash_policy::is_deleted(_slot(pos))) {
+					return true;
+				}
+				distance = existing_distance;
+			}
+
+			pos = _next(pos);
+			distance++;
+		}
+
+		return false;
+	}
+
+	// Walks the probe chain of `key` once. If the key exists its value is returned,
+	// otherwise the entry gets inserted with `value` at the point where the walk ended,
+	// so callers don't need a separate lookup before inserting.
+	// Returns nullptr if the entry doesn't exist and can't be inserted.
+	template <typename TK, typename TV>
+	TValue *_find_or_insert(hash_type hash, TK &&key, TV &&value, bool &inserted)
 	{
-		hashmap<TKey, TValue> map = {};
+		uint32_t distance = 0;
+		uint32_t pos = _home(hash);
 
-		map.m_buffer = (uint8_t *) buffer;
-		map.m_num_elements = 0;
-		map.m_capacity = (size_t)(buffer_size / (sizeof(TKey) + sizeof(TValue) + sizeof(uint32_t)));
+		inserted = false;
 
-		size_t capacity = map.m_capacity;
+		while (distance < m_capacity) {
+			if (distance > hash_policy::max_distance) {
+				return nullptr;
+			}
 
-		uint32_t *hashes = (uint32_t *) map.m_buffer;
+			if (hash_policy::is_empty(_slot(pos))) {
+				break;
+			}
 
-		for (size_t i = 0; i < capacity; i++) {
-			hashes[i] = EMPTY_HASH;
+			if (_slot(pos) == hash_policy::make(hash, distance) && equality_policy::equal(_key(pos), key)) {
+				return &_value(pos);
+			}
+
+			// Robin hood ordering: the key would have been placed here or earlier.
+			if (_get_probe_distance(pos, _slot(pos)) < distance) {
+				break;
+			}
+
+			pos = _next(pos);
+			distance++;
 		}
 
-		return map;
+		if (distance == m_capacity || !_insert_at(pos, distance, hash, static_cast<TK &&>(key), static_cast<TV &&>(value))) {
+			return nullptr;
+		}
+
+		inserted = true;
+		return &_value(pos);
 	}
 
-	/// Associate a key with a value. The hash is the hash value of the key. This hashmap doesn't
-	/// perform any hashing itself, so the caller has to provide the hash.
-	/// For collision resolution, the key itself has to be provided as well.
-	void set(uint32_t hash, const TKey &key, const TValue &value)
+	void _prefetch_home(hash_type hash) const
 	{
-		hash = _hash(hash);
-		uint32_t pos = 0;
-		bool exists = _lookup_pos(hash, key, pos);
+		uint32_t pos = _home(hash);
 
-		TValue *values = (TValue *) (m_buffer + (sizeof(uint32_t) + sizeof(TKey)) * m_capacity);
+		hash_group::prefetch(&_slot(pos));
+		hash_group::prefetch(&_key(pos));
+	}
 
-		if (exists) {
-			values[pos] = value;
-		} else {
-			insert(hash, key, value);
+	// Inserts an entry while the map is being rehashed in place. Slots still holding an
+	// entry that wasn't rehashed yet are marked as deleted. Those count as free, the
+	// entry taken out of such a slot gets inserted next, starting at its own home slot.
+	// `grow_in_place()` checked with `_can_rehash()` that no entry ends up further away
+	// from its home than the hash policy can store, and the table has more slots than
+	// entries, so every entry finds a slot.
+	template <typename THashFn>
+	void _insert_rehashing(hash_type hash, TKey key, TValue value, THashFn hash_fn)
+	{
+		uint32_t distance = 0;
+		uint32_t pos = _home(hash);
+		slot_type slot = hash_policy::make(hash, 0);
+
+		for (;;) {
+			if (hash_policy::is_empty(_slot(pos))) {
+				_slot(pos) = hash_policy::with_distance(slot, distance);
+				_key(pos) = key;
+				_value(pos) = value;
+				m_num_elements++;
+				return;
+			}
+
+			if (hash_policy::is_deleted(_slot(pos))) {
+				// take the slot and continue with the entry that was in it
+				hash_type pending_hash = _pending_hash(pos, hash_fn);
+
+				_slot(pos) = hash_policy::with_distance(slot, distance);
+				_swap(key, _key(pos));
+				_swap(value, _value(pos));
+				m_num_elements++;
+
+				hash = pending_hash;
+				distance = 0;
+				pos = _home(hash);
+				slot = hash_policy::make(hash, 0);
+				continue;
+			}
+
+			uint32_t existing_distance = _get_probe_distance(pos, _slot(pos));
+			if (existing_distance < distance) {
+				slot = hash_policy::with_distance(slot, distance);
+				_swap(slot, _slot(pos));
+				_swap(key, _key(pos));
+				_swap(value, _value(pos));
+				distance = existing_distance;
+			}
+
+			pos = _next(pos);
+			distance++;
 		}
 	}
 
-	/// Lookup a value in the hashmap. The hash is the hash of the key. The key value itself
-	/// has to be provided in case a collision occurs.
-	/// If an entry is found, the value will be written to the out-parameter `value`.
-	/// Returns true if an entry was found, false otherwise.
-	bool lookup(uint32_t hash, const TKey &key, TValue &value) const
+	template <typename THashFn>
+	hash_type _pending_hash(uint32_t pos, THashFn hash_fn) const
 	{
-		uint32_t pos = 0;
-		bool exists = _lookup_pos(_hash(hash), key, pos);
+		if (hash_policy::stores_hash) {
+			return hash_policy::hash(_slot(pos));
+		}
 
-		TValue *values = (TValue *) (m_buffer + (sizeof(uint32_t) + sizeof(TKey)) * m_capacity);
+		return _hash(hash_fn(_key(pos)));
+	}
 
-		if (exists) {
-			value = values[pos];
-			return true;
+	// Finds out without modifying anything if all entries stay within the maximum probe
+	// distance when they get redistributed over `new_capacity` slots.
+	// Robin hood ordering keeps the entries of a run sorted by their home slots, so the
+	// probe distances only depend on how many entries every home slot has: walking the
+	// slots in order, the entries that still wait for a slot form a queue, and the last
+	// entry of a home slot ends up as many slots away from it as the queue is long.
+	// The entries per home slot get counted into `scratch`, one window of `scratch_size`
+	// slots at a time, a small scratch only costs more passes over the entries.
+	template <typename THashFn>
+	bool _can_rehash(size_t new_capacity, THashFn hash_fn, uint8_t *scratch, size_t scratch_size) const
+	{
+		size_t window_start = 0;
+		size_t window_end = 0;
+		size_t queued = 0;
+
+		// The queue only holds the entries that wrap around from the end of the table
+		// once the walk got past a free slot, so the walk continues into a second round
+		// until it gets to one.
+		for (size_t i = 0; i < 2 * new_capacity; i++) {
+			size_t pos = i < new_capacity ? i : i - new_capacity;
+
+			if (pos < window_start || pos >= window_end) {
+				window_start = pos;
+				window_end = pos + scratch_size < new_capacity ? pos + scratch_size : new_capacity;
+
+				for (size_t j = 0; j < window_end - window_start; j++) {
+					scratch[j] = 0;
+				}
+
+				for (uint32_t j = 0; j < m_capacity; j++) {
+					if (hash_policy::is_empty(_slot(j)) || hash_policy::is_deleted(_slot(j))) {
+						continue;
+					}
+
+					size_t home = capacity_policy::index(_pending_hash(j, hash_fn), new_capacity);
+					if (home >= window_start && home < window_end && scratch[home - window_start] < 0xFF) {
+						scratch[home - window_start]++;
+					}
+				}
+			}
+
+			queued += scratch[pos - window_start];
+			if (queued > (size_t) hash_policy::max_distance + 1) {
+				return false;
+			}
+
+			if (queued > 0) {
+				queued--;
+			} else if (i >= new_capacity) {
+				return true;
+			}
 		}
 
-		return false;
+		return true;
 	}
 
-	/// Get the value associated with the given hash and key.
-	/// This uses `lookup()` internally, but discards the bool return value
-	/// and returns the value instead of having it as an out parameter.
-	/// WARNING: If the entry was not found then the return value is **undefined**.
-	inline TValue get(uint32_t hash, const TKey &key) const
+	// Used as the hash function for in place growth when the hashes are stored.
+	struct _stored_hash {
+		hash_type operator()(const TKey &) const
+		{
+			return 0;
+		}
+	};
+
+	// Destroys the entry in the slot, the slot is left uninitialized.
+	void _destroy_at(uint32_t pos)
 	{
-		TValue value;
-		lookup(_hash(hash), key, value);
-		return value;
+		_key(pos).~TKey();
+		_value(pos).~TValue();
 	}
 
-	/// Remove an entry from the hashtable by proving the hash and the key value, in case a
-	/// collision occurs.
-	void remove(uint32_t hash, const TKey &key)
+	void _remove_at(uint32_t pos)
 	{
-		uint32_t pos = 0;
-		bool exists = _lookup_pos(_hash(hash), key, pos);
-		uint32_t *hashes = (uint32_t *) m_buffer;
+		m_num_elements--;
 
-		if (!exists) {
+		_destroy_at(pos);
+
+		if (!TTraits::backward_shift_deletion) {
+			_slot(pos) = hash_policy::mark_deleted(_slot(pos));
 			return;
 		}
 
-		hashes[pos] |= DELETED_HASH_BIT;
-		m_num_elements--;
-	}
+		// Move every following entry of the chain one slot back until we hit an
+		// empty slot or an entry that already sits in its ideal position.
+		uint32_t next = _next(pos);
+		for (size_t i = 1; i < m_capacity; i++) {
+			if (hash_policy::is_empty(_slot(next))) {
+				break;
+			}
 
-	/// Create an iterator for the hashmap. Use `iter_next()` to advance the iteration.
-	iter iter_start() const
-	{
-		hashmap<TKey, TValue>::iter iter = {};
-		iter.offset = 0;
-		return iter;
+			uint32_t distance = _get_probe_distance(next, _slot(next));
+			if (distance == 0) {
+				break;
+			}
+
+			_slot(pos) = hash_policy::with_distance(_slot(next), distance - 1);
+
+			if (!hash_policy::is_deleted(_slot(next))) {
+				new (&_key(pos)) TKey(static_cast<TKey &&>(_key(next)));
+				new (&_value(pos)) TValue(static_cast<TValue &&>(_value(next)));
+				_destroy_at(next);
+			}
+
+			pos = next;
+			next = _next(next);
+		}
+
+		_slot(pos) = hash_policy::EMPTY_HASH;
 	}
 
-	/// Advance the iterator to the next elements found. Key and value will be written to the
-	/// out parameters `key` and `value` in case a next iteration was possible.
-	/// In that case the function will return true.
-	/// The function will return false when the end was reached.
-	bool iter_next(iter &iter, TKey &key, TValue &value) const
+	// Calls `fn(pos)` for every slot that holds a live entry. Whole groups of hashes are
+	// checked at once, so sparse tables don't cost a branch per empty slot.
+	template <typename TFn>
+	void _for_each_pos(TFn fn) const
 	{
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		TKey *keys = (TKey *) (m_buffer + sizeof(uint32_t) * m_capacity);
-		TValue *values = (TValue *) (m_buffer + (sizeof(uint32_t) + sizeof(TKey)) * m_capacity);
+		size_t pos = 0;
 
-		for (size_t i = iter.offset; i < m_capacity; i++) {
-			if (hashes[i] == EMPTY_HASH) {
+		while (pos < m_capacity) {
+			if (!layout::contiguous_slots || pos + hash_policy::group_width > m_capacity) {
+				if (!hash_policy::is_empty(_slot(pos)) && !hash_policy::is_deleted(_slot(pos))) {
+					fn((uint32_t) pos);
+				}
+				pos++;
 				continue;
 			}
-			if (hashes[i] & DELETED_HASH_BIT) {
-				continue;
+
+			uint32_t live = hash_policy::occupied(&_slot(pos));
+			while (live) {
+				fn((uint32_t) pos + hash_group::first(live));
+				live &= live - 1;
 			}
 
-			key = keys[i];
-			value = values[i];
-			iter.offset = i + 1;
-			return true;
+			pos += hash_policy::group_width;
 		}
-		return false;
 	}
 
-	/// Calculates the load factor of the map. When the load factor is greater than 0.95
-	/// then `copy()` should be used to relocate the hashmap for better performance.
-	inline float load_factor() const
+	// The first slot at or after `pos` that holds a live entry, or the capacity if
+	// there is none.
+	size_t _next_occupied(size_t pos) const
 	{
-		return m_num_elements / (float) m_capacity;
+		while (pos < m_capacity) {
+			if (!layout::contiguous_slots || pos + hash_policy::group_width > m_capacity) {
+				if (!hash_policy::is_empty(_slot(pos)) && !hash_policy::is_deleted(_slot(pos))) {
+					return pos;
+				}
+				pos++;
+				continue;
+			}
+
+			uint32_t live = hash_policy::occupied(&_slot(pos));
+			if (live) {
+				return pos + hash_group::first(live);
+			}
+
+			pos += hash_policy::group_width;
+		}
+
+		return m_capacity;
 	}
 
-	/// Creates a new hashmap using a different buffer. All the entries of the
-	/// current map will be inserted into the new map.
-	hashmap<TKey, TValue> copy(size_t buffer_size, void *buffer) const
+	// The key and value are only moved from when a new entry gets inserted, so they are
+	// still intact for the assignment if the key already existed.
+	template <typename TK, typename TV>
+	void _set(hash_type hash, TK &&key, TV &&value)
 	{
-		hashmap<TKey, TValue> new_hashmap = hashmap::create(buffer_size, buffer);
+		bool inserted = false;
+		TValue *existing = _find_or_insert(_hash(hash), static_cast<TK &&>(key), static_cast<TV &&>(value), inserted);
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		TKey *keys = (TKey *) (m_buffer + sizeof(uint32_t) * m_capacity);
-		TValue *values = (TValue *) (m_buffer + (sizeof(uint32_t) + sizeof(TKey)) * m_capacity);
+		if (existing && !inserted) {
+			*existing = static_cast<TV &&>(value);
+		}
+	}
 
-		for (size_t i = 0; i < m_capacity; i++) {
-			if (hashes[i] == EMPTY_HASH) {
-				continue;
+	// The most partitions `bulk_build()` and the parallel `copy()` split a table into,
+	// two per task.
+	static const size_t _max_partitions = 256;
+
+	// Partitions smaller than this aren't worth a task of their own.
+	static const size_t _min_partition_slots = 4096;
+
+	// The input of `bulk_build()`. Keys can repeat, the last value wins like with `set()`.
+	struct _array_source {
+		static const bool unique_keys = false;
+
+		const hash_type *hashes;
+		const TKey *keys;
+		const TValue *values;
+		size_t n;
+
+		size_t num_entries() const
+		{
+			return n;
+		}
+
+		// Calls `fn(i, hash)` for every entry in order.
+		template <typename TFn>
+		void scan(TFn fn) const
+		{
+			for (size_t i = 0; i < n; i++) {
+				fn(i, _hash(hashes[i]));
 			}
-			if (hashes[i] & DELETED_HASH_BIT) {
-				continue;
+		}
+
+		hash_type hash(size_t i) const
+		{
+			return _hash(hashes[i]);
+		}
+
+		const TKey &key(size_t i) const
+		{
+			return keys[i];
+		}
+
+		const TValue &value(size_t i) const
+		{
+			return values[i];
+		}
+	};
+
+	// The input of the parallel `copy()`, the occupied slots of another map.
+	template <typename THashFn>
+	struct _map_source {
+		static const bool unique_keys = true;
+
+		const hashmap *map;
+		THashFn hash_fn;
+
+		size_t num_entries() const
+		{
+			return map->m_num_elements;
+		}
+
+		template <typename TFn>
+		void scan(TFn fn) const
+		{
+			for (size_t pos = map->_next_occupied(0); pos < map->m_capacity; pos = map->_next_occupied(pos + 1)) {
+				fn(pos, map->_pending_hash((uint32_t) pos, hash_fn));
 			}
+		}
 
-			new_hashmap.insert(hashes[i], keys[i], values[i]);
+		hash_type hash(size_t i) const
+		{
+			return map->_pending_hash((uint32_t) i, hash_fn);
 		}
 
-		return new_hashmap;
+		const TKey &key(size_t i) const
+		{
+			return map->_key(i);
+		}
 
-	}
+		const TValue &value(size_t i) const
+		{
+			return map->_value(i);
+		}
+	};
 
-	/// The number of elements in this hash map.
-	size_t num_elements() const
+	// A range of home slots that gets built by a single task.
+	struct _partition {
+		uint32_t begin;
+		uint32_t end;
+
+		// How many slots of the following partition the probe chains may run into.
+		size_t spill;
+
+		// The entries with their home slot in the partition, a range of the indices
+		// `_build()` sorted by partition.
+		size_t first;
+		size_t last;
+
+		size_t num_added;
+
+		// Where the entries that were left for later start in the range of the
+		// partition, `last` if there are none.
+		size_t first_deferred;
+	};
+
+	// Runs every task on the calling thread.
+	struct _serial_executor {
+		template <typename TTask>
+		void operator()(size_t num_tasks, const TTask &task) const
+		{
+			for (size_t i = 0; i < num_tasks; i++) {
+				task(i);
+			}
+		}
+	};
+
+	// Sets up a map like `create()`, but the slots are emptied by `num_threads` tasks.
+	template <typename TExecutor>
+	static hashmap _create_parallel(size_t buffer_size, void *buffer, size_t num_threads, TExecutor &executor)
 	{
-		return m_num_elements;
-	}
+		hashmap map = {};
+
+		map.m_buffer = (uint8_t *) buffer;
+		map.m_num_elements = 0;
+		map.m_capacity = capacity_policy::adjust(layout::max_slots(buffer_size));
+		map._update_regions();
+
+		if (num_threads < 1) {
+			num_threads = 1;
+		}
+
+		const hashmap *target = &map;
+		uint64_t capacity = map.m_capacity;
+
+		executor(num_threads, [target, capacity, num_threads](size_t task) {
+			size_t end = (size_t) (capacity * (task + 1) / num_threads);
+			for (size_t i = (size_t) (capacity * task / num_threads); i < end; i++) {
+				target->_slot(i) = hash_policy::EMPTY_HASH;
+			}
+		});
+
+		return map;
+	}
+
+	// Whether there is an empty slot among the `max_steps` slots starting at `pos`. In a
+	// table without tombstones, inserting an entry that has its home slot at `pos` doesn't
+	// touch anything past that slot.
+	bool _empty_within(uint32_t pos, size_t max_steps) const
+	{
+		for (size_t i = 0; i < max_steps; i++) {
+			if (hash_policy::is_empty(_slot(pos))) {
+				return true;
+			}
+			pos = _next(pos);
+		}
+
+		return false;
+	}
+
+	template <typename TSource>
+	void _build_insert(const TSource &source, size_t i, hash_type hash)
+	{
+		if (TSource::unique_keys) {
+			_insert_at(_home(hash), 0, hash, source.key(i), source.value(i));
+			return;
+		}
+
+		bool inserted = false;
+		TValue *existing = _find_or_insert(hash, source.key(i), source.value(i), inserted);
+
+		if (existing && !inserted) {
+			*existing = source.value(i);
+		}
+	}
+
+	// Inserts the entries of the partition, in the order of the source. Probe chains may
+	// run into the following partition, but no further. The first entry that could reach
+	// further stops the task; it and the entries after it are inserted by `_build()` once
+	// all tasks are done.
+	// The element count is kept in a copy of the map, so all tasks can run at once.
+	template <typename TSource>
+	void _build_partition(const TSource &source, const uint32_t *indices, _partition &part) const
+	{
+		hashmap map = *this;
+		map.m_num_elements = 0;
+
+		part.first_deferred = part.last;
+
+		for (size_t k = part.first; k < part.last; k++) {
+			hash_type hash = source.hash(indices[k]);
+			uint32_t home = map._home(hash);
+
+			if (!map._empty_within(home, part.end - home + part.spill)) {
+				part.first_deferred = k;
+				break;
+			}
+
+			map._build_insert(source, indices[k], hash);
+		}
+
+		part.num_added = map.m_num_elements;
+	}
+
+	// The partition `home` belongs to, out of `num_partitions` that split the table like
+	// in `_build()`.
+	size_t _partition_of(uint32_t home, size_t num_partitions) const
+	{
+		return (size_t) (((uint64_t) home + 1) * num_partitions - 1) / m_capacity;
+	}
+
+	// Inserts all entries of `source` into this empty map with up to `num_threads` tasks.
+	// The table gets split into twice as many partitions of home slots as there are
+	// tasks. First the even partitions are built at the same time, then the odd ones.
+	// Since a probe chain never reaches past the partition after its own, no two tasks
+	// ever touch the same slot. Chains that cross a partition boundary are simply
+	// continued by the task of the next partition in the second round.
+	// Before that the indices of the entries get sorted by partition into `scratch`
+	// with a counting sort, so every task only looks at its own entries. Without enough
+	// scratch memory for that everything is inserted on the calling thread.
+	template <typename TSource, typename TExecutor>
+	void _build(const TSource &source, size_t scratch_size, void *scratch, size_t num_threads, TExecutor &executor)
+	{
+		if (num_threads > m_capacity / (2 * _min_partition_slots)) {
+			num_threads = m_capacity / (2 * _min_partition_slots);
+		}
+		if (num_threads > _max_partitions / 2) {
+			num_threads = _max_partitions / 2;
+		}
+
+		size_t num_entries = source.num_entries();
+
+		if (num_threads < 2 || num_entries > 0xFFFFFFFF || scratch_size < build_scratch_size(num_entries)) {
+			source.scan([this, &source](size_t i, hash_type hash) {
+				_build_insert(source, i, hash);
+			});
+			return;
+		}
+
+		size_t num_partitions = 2 * num_threads;
+		_partition parts[_max_partitions];
+
+		for (size_t p = 0; p < num_partitions; p++) {
+			parts[p].begin = (uint32_t) ((uint64_t) m_capacity * p / num_partitions);
+			parts[p].end = (uint32_t) ((uint64_t) m_capacity * (p + 1) / num_partitions);
+			parts[p].last = 0;
+		}
+		for (size_t p = 0; p < num_partitions; p++) {
+			const _partition &next = parts[(p + 1) % num_partitions];
+			parts[p].spill = next.end - next.begin;
+		}
+
+		const hashmap *map = this;
+		_partition *partitions = parts;
+
+		// Count the entries of every partition, then put their indices into place. The
+		// sort is stable, so every partition sees its entries in the order of the source.
+		source.scan([map, partitions, num_partitions](size_t, hash_type hash) {
+			partitions[map->_partition_of(map->_home(hash), num_partitions)].last++;
+		});
+
+		size_t offset = 0;
+		for (size_t p = 0; p < num_partitions; p++) {
+			parts[p].first = offset;
+			offset += parts[p].last;
+			parts[p].last = parts[p].first;
+		}
+
+		uint32_t *indices = (uint32_t *) scratch;
+
+		source.scan([map, partitions, num_partitions, indices](size_t i, hash_type hash) {
+			indices[partitions[map->_partition_of(map->_home(hash), num_partitions)].last++] = (uint32_t) i;
+		});
+
+		executor(num_threads, [map, &source, indices, partitions](size_t task) {
+			map->_build_partition(source, indices, partitions[2 * task]);
+		});
+		executor(num_threads, [map, &source, indices, partitions](size_t task) {
+			map->_build_partition(source, indices, partitions[2 * task + 1]);
+		});
+
+		for (size_t p = 0; p < num_partitions; p++) {
+			m_num_elements += parts[p].num_added;
+		}
+
+		for (size_t p = 0; p < num_partitions; p++) {
+			const _partition &part = parts[p];
+
+			for (size_t k = part.first_deferred; k < part.last; k++) {
+				_build_insert(source, indices[k], source.hash(indices[k]));
+			}
+		}
+	}
+
+public:
+
+	/// An iterator for iterating over key-value pairs. Use `iter_start()` to acquire
+	/// such an iterator. Use `iter_next()` to advance the iteration.
+	struct iter {
+		size_t offset;
+	};
+
+	/// The size of a buffer that can hold at least `num_elements` entries with the
+	/// policies of this hashmap type.
+	static constexpr size_t buffer_size(size_t num_elements)
+	{
+		return layout::buffer_size(capacity_policy::slots_for(num_elements));
+	}
+
+	/// The size of the scratch buffer the parallel `bulk_build()` and `copy()` need for
+	/// `num_entries` entries. It holds the index of every entry as a `uint32_t`, so it
+	/// has to be aligned like one.
+	static constexpr size_t build_scratch_size(size_t num_entries)
+	{
+		return num_entries * sizeof(uint32_t);
+	}
+
+	/// This function constructs a new hashmap value.
+	/// The buffer is a chunk of memory that will be used as the storage. It should probably be
+	/// created by using the `CF_HASHMAP_GET_BUFFER_SIZE` macro.
+	/// Don't modify the contents of the buffer after handing it to a hashmap.
+	static hashmap create(size_t buffer_size, void *buffer)
+	{
+		hashmap map = {};
+
+		map.m_buffer = (uint8_t *) buffer;
+		map.m_num_elements = 0;
+		map.m_capacity = capacity_policy::adjust(layout::max_slots(buffer_size));
+		map._update_regions();
+
+		size_t capacity = map.m_capacity;
+
+		for (size_t i = 0; i < capacity; i++) {
+			map._slot(i) = hash_policy::EMPTY_HASH;
+		}
+
+		return map;
+	}
+
+	/// Like `create()`, but checks the buffer first. Returns false and leaves `map`
+	/// untouched if the buffer isn't aligned to what the layout policy needs to line up
+	/// its regions (or buckets) with cache lines and with the alignment of the keys and
+	/// values, or if it can't hold a single entry.
+	static bool create(size_t buffer_size, void *buffer, hashmap &map)
+	{
+		if ((uintptr_t) buffer % layout::alignment() != 0) {
+			return false;
+		}
+
+		if (capacity_policy::adjust(layout::max_slots(buffer_size)) == 0) {
+			return false;
+		}
+
+		map = create(buffer_size, buffer);
+		return true;
+	}
+
+	/// The number of bytes `save_header()` writes. In a snapshot the table follows this
+	/// many bytes after the start of the header.
+	static const size_t snapshot_header_size = 64;
+
+	/// Writes a `cf::hashmap_snapshot_header` describing this map to `header`, which needs
+	/// room for `snapshot_header_size` bytes and should be 8 byte aligned.
+	/// The header followed by the first `table_size` bytes of the buffer of the map forms
+	/// a snapshot that `attach()` can use, for example after writing both to a file and
+	/// mapping it into memory with `mmap()`. A map can also be created in a file mapping
+	/// right away, `snapshot_header_size` bytes after its start, with the header written
+	/// in front of it once the map is done.
+	/// Keys and values have to be trivially copyable, since they get stored as they are.
+	void save_header(void *header) const
+	{
+		static_assert(std::is_trivially_copyable<TKey>::value && std::is_trivially_copyable<TValue>::value,
+		              "snapshots store keys and values byte by byte, which needs trivially copyable keys and values");
+		static_assert(sizeof(hashmap_snapshot_header) <= snapshot_header_size, "the snapshot header doesn't fit");
+
+		uint8_t *bytes = (uint8_t *) header;
+		for (size_t i = 0; i < snapshot_header_size; i++) {
+			bytes[i] = 0;
+		}
+
+		hashmap_snapshot_header *h = (hashmap_snapshot_header *) header;
+
+		h->magic = hashmap_snapshot_header::MAGIC;
+		h->version = hashmap_snapshot_header::VERSION;
+		h->capacity = m_capacity;
+		h->num_elements = m_num_elements;
+		h->table_size = layout::buffer_size(m_capacity);
+		h->key_size = sizeof(TKey);
+		h->key_align = alignof(TKey);
+		h->value_size = sizeof(TValue);
+		h->value_align = alignof(TValue);
+		h->capacity_policy = capacity_policy::snapshot_id;
+		h->hash_policy = hash_policy::snapshot_id;
+		h->layout_policy = TTraits::layout_policy::snapshot_id;
+	}
+
+	/// Uses a snapshot written with the help of `save_header()` as the storage of `map`.
+	/// `buffer` points to the header, the table starts `snapshot_header_size` bytes after
+	/// it. Unlike `create()` this doesn't touch the table at all, so a mapped file is ready
+	/// for lookups right away and its pages only get loaded once they are used.
+	/// Returns false and leaves `map` untouched if the header doesn't describe a map of
+	/// this type (other key or value types, policies, format version or byte order) or the
+	/// table doesn't fit into `buffer_size`.
+	/// WARNING: Only the header is checked, a table that was modified or damaged after it
+	/// was saved leads to **undefined** behaviour.
+	static bool attach(size_t buffer_size, void *buffer, hashmap &map)
+	{
+		static_assert(std::is_trivially_copyable<TKey>::value && std::is_trivially_copyable<TValue>::value,
+		              "snapshots store keys and values byte by byte, which needs trivially copyable keys and values");
+
+		if (buffer_size < snapshot_header_size) {
+			return false;
+		}
+
+		const hashmap_snapshot_header *h = (const hashmap_snapshot_header *) buffer;
+
+		if (h->magic != hashmap_snapshot_header::MAGIC || h->version != hashmap_snapshot_header::VERSION) {
+			return false;
+		}
+
+		if (h->key_size != sizeof(TKey) || h->key_align != alignof(TKey) ||
+		    h->value_size != sizeof(TValue) || h->value_align != alignof(TValue)) {
+			return false;
+		}
+
+		if (h->capacity_policy != capacity_policy::snapshot_id ||
+		    h->hash_policy != hash_policy::snapshot_id ||
+		    h->layout_policy != TTraits::layout_policy::snapshot_id) {
+			return false;
+		}
+
+		// Slot positions are 32 bit, and the capacity has to be one the policy could
+		// have picked itself.
+		if (h->capacity == 0 || h->capacity > 0xFFFFFFFF ||
+		    capacity_policy::adjust((size_t) h->capacity) != h->capacity ||
+		    h->num_elements > h->capacity) {
+			return false;
+		}
+
+		if (h->table_size != layout::buffer_size((size_t) h->capacity) ||
+		    h->table_size > buffer_size - snapshot_header_size) {
+			return false;
+		}
+
+		if ((uintptr_t) ((uint8_t *) buffer + snapshot_header_size) % layout::alignment() != 0) {
+			return false;
+		}
+
+		map = hashmap();
+		map.m_buffer = (uint8_t *) buffer + snapshot_header_size;
+		map.m_num_elements = (size_t) h->num_elements;
+		map.m_capacity = (size_t) h->capacity;
+		map._update_regions();
+
+		return true;
+	}
+
+	/// Constructs a new hashmap in `buffer` like `create()` and inserts `n` entries at once.
+	/// Entry `i` has the hash `hashes[i]`, the key `keys[i]` and the value `values[i]`,
+	/// if a key appears more than once the last value wins, like with `set()`.
+	/// The table is split into ranges of home slots that get filled by up to `num_threads`
+	/// tasks at the same time. This library doesn't start any threads itself, instead
+	/// `executor(num_tasks, task)` gets called with a function object and has to call
+	/// `task(i)` once for every `i` below `num_tasks`, from as many threads as it likes,
+	/// and only return once all of those calls returned.
+	/// Before the tasks start, the calling thread sorts the indices of the entries by the
+	/// range their home slot is in, so every task only looks at its own entries. The
+	/// indices go into `scratch`, which needs `build_scratch_size(n)` bytes. If it's
+	/// smaller, all entries get inserted on the calling thread instead. That also happens
+	/// when `num_threads` is below 2 or the table is too small to split between two tasks.
+	/// The executor gets called three times, once to empty the slots and once for each of
+	/// two rounds of inserts. When the entries get inserted on the calling thread, it only
+	/// gets called once, to empty the slots.
+	template <typename TExecutor>
+	static hashmap bulk_build(size_t buffer_size, void *buffer, const hash_type *hashes, const TKey *keys, const TValue *values, size_t n,
+	                          size_t scratch_size, void *scratch, size_t num_threads, TExecutor executor)
+	{
+		hashmap map = _create_parallel(buffer_size, buffer, num_threads, executor);
+
+		_array_source source = { hashes, keys, values, n };
+		map._build(source, scratch_size, scratch, num_threads, executor);
+
+		return map;
+	}
+
+	/// Like the other `bulk_build()`, but everything runs on the calling thread.
+	static hashmap bulk_build(size_t buffer_size, void *buffer, const hash_type *hashes, const TKey *keys, const TValue *values, size_t n)
+	{
+		return bulk_build(buffer_size, buffer, hashes, keys, values, n, 0, nullptr, 1, _serial_executor());
+	}
+
+	/// Associate a key with a value. The hash is the hash value of the key, computed by
+	/// the caller. `set(key, value)` computes it with the hasher policy instead.
+	/// For collision resolution, the key itself has to be provided as well.
+	void set(hash_type hash, const TKey &key, const TValue &value)
+	{
+		_set(hash, key, value);
+	}
+
+	/// Like `set()`, but the key and value are moved into the map instead of being
+	/// copied.
+	void set(hash_type hash, TKey &&key, TValue &&value)
+	{
+		_set(hash, static_cast<TKey &&>(key), static_cast<TValue &&>(value));
+	}
+
+	/// Like `set()`, but the hash is computed from the key with the `hasher_policy` of
+	/// the traits (`cf::hasher` by default), so the caller doesn't have to hash keys.
+	/// The functions that take a hash find such an entry with the hash
+	/// `cf::fold_hash<hash_type>(hasher_policy::hash(key))`.
+	void set(const TKey &key, const TValue &value)
+	{
+		_set(_hash_key(key), key, value);
+	}
+
+	/// Like `set(key, value)`, but the key and value are moved into the map.
+	void set(TKey &&key, TValue &&value)
+	{
+		hash_type hash = _hash_key(key);
+		_set(hash, static_cast<TKey &&>(key), static_cast<TValue &&>(value));
+	}
+
+	/// Returns a pointer to the value of an entry inside of the buffer, or `nullptr` if
+	/// there is no entry for the key. The value can be read and modified in place
+	/// without copying it. The pointer stays valid until the map gets modified.
+	TValue *find(hash_type hash, const TKey &key)
+	{
+		return find<TKey>(hash, key);
+	}
+
+	/// Like `find()`, but with a key of any type the equality policy can compare keys
+	/// with, so no temporary `TKey` has to be built. The hash has to be the same as the
+	/// hash of the equal `TKey`.
+	template <typename TK>
+	_if_comparable<TK, TValue *> find(hash_type hash, const TK &key)
+	{
+		uint32_t pos = 0;
+		bool exists = _lookup_pos(_hash(hash), key, pos);
+
+		return exists ? &_value(pos) : nullptr;
+	}
+
+	/// Like `find()`, but read-only.
+	const TValue *find(hash_type hash, const TKey &key) const
+	{
+		return find<TKey>(hash, key);
+	}
+
+	/// Like `find()`, but read-only.
+	template <typename TK>
+	_if_comparable<TK, const TValue *> find(hash_type hash, const TK &key) const
+	{
+		uint32_t pos = 0;
+		bool exists = _lookup_pos(_hash(hash), key, pos);
+
+		return exists ? &_value(pos) : nullptr;
+	}
+
+	/// Like `find()`, but the hash is computed with the hasher policy.
+	TValue *find(const TKey &key)
+	{
+		return find<TKey>(_hash_key(key), key);
+	}
+
+	/// Like `find()`, but the hash is computed with the hasher policy.
+	const TValue *find(const TKey &key) const
+	{
+		return find<TKey>(_hash_key(key), key);
+	}
+
+	/// Returns a reference to the value of an entry inside of the buffer. If there is
+	/// no entry for the key yet one gets inserted with a value of `TValue()`. Searching
+	/// and inserting only walks the probe chain once.
+	/// The reference stays valid until the map gets modified.
+	/// WARNING: If the entry doesn't exist and can't be inserted, because the map is full
+	/// or the hash policy can't store the probe distance, the behaviour is **undefined**.
+	/// Use `upsert()` if that can happen.
+	TValue &get_or_insert(hash_type hash, const TKey &key)
+	{
+		bool inserted = false;
+		return *_find_or_insert(_hash(hash), key, TValue(), inserted);
+	}
+
+	/// Like `get_or_insert()`, but the hash is computed with the hasher policy.
+	TValue &get_or_insert(const TKey &key)
+	{
+		return get_or_insert(_hash_key(key), key);
+	}
+
+	/// Calls `fn(value)` with a reference to the value of the entry for the key, so it
+	/// can be modified in place. If there is no entry yet one gets inserted with a value
+	/// of `TValue()` first. Searching and inserting only walks the probe chain once.
+	/// Returns false, without calling `fn`, if the entry didn't exist and couldn't be
+	/// inserted.
+	template <typename TFn>
+	bool upsert(hash_type hash, const TKey &key, TFn fn)
+	{
+		bool inserted = false;
+		TValue *value = _find_or_insert(_hash(hash), key, TValue(), inserted);
+
+		if (!value) {
+			return false;
+		}
+
+		fn(*value);
+		return true;
+	}
+
+	/// Like `upsert()`, but the hash is computed with the hasher policy.
+	template <typename TFn>
+	bool upsert(const TKey &key, TFn fn)
+	{
+		return upsert(_hash_key(key), key, fn);
+	}
+
+	/// Lookup a value in the hashmap. The hash is the hash of the key. The key value itself
+	/// has to be provided in case a collision occurs.
+	/// If an entry is found, the value will be written to the out-parameter `value`.
+	/// Returns true if an entry was found, false otherwise.
+	bool lookup(hash_type hash, const TKey &key, TValue &value) const
+	{
+		return lookup<TKey>(hash, key, value);
+	}
+
+	/// Like `lookup()`, but the hash is computed with the hasher policy.
+	bool lookup(const TKey &key, TValue &value) const
+	{
+		return lookup<TKey>(_hash_key(key), key, value);
+	}
+
+	/// Like `lookup()`, but with a key of any type the equality policy can compare keys
+	/// with.
+	template <typename TK>
+	_if_comparable<TK, bool> lookup(hash_type hash, const TK &key, TValue &value) const
+	{
+		uint32_t pos = 0;
+		bool exists = _lookup_pos(_hash(hash), key, pos);
+
+		if (exists) {
+			value = _value(pos);
+			return true;
+		}
+
+		return false;
+	}
+
+	/// Looks up `n` entries at once. For every index `i` the hash `hashes[i]` and the key
+	/// `keys[i]` are looked up, `found[i]` is set to whether an entry exists and if it
+	/// does, its value is written to `out[i]`.
+	/// While an entry is resolved, the home slots of the entries a few positions ahead
+	/// get prefetched, so the cache misses of the whole batch overlap instead of being
+	/// paid one after another.
+	void lookup_batch(const hash_type *hashes, const TKey *keys, TValue *out, bool *found, size_t n) const
+	{
+		size_t window = TTraits::prefetch_distance < n ? TTraits::prefetch_distance : n;
+		for (size_t i = 0; i < window; i++) {
+			_prefetch_home(_hash(hashes[i]));
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			if (i + window < n) {
+				_prefetch_home(_hash(hashes[i + window]));
+			}
+
+			uint32_t pos = 0;
+			found[i] = _lookup_pos(_hash(hashes[i]), keys[i], pos);
+
+			if (found[i]) {
+				out[i] = _value(pos);
+			}
+		}
+	}
+
+	/// Get the value associated with the given hash and key.
+	/// This uses `lookup()` internally, but discards the bool return value
+	/// and returns the value instead of having it as an out parameter.
+	/// WARNING: If the entry was not found then the return value is **undefined**.
+	inline TValue get(hash_type hash, const TKey &key) const
+	{
+		return get<TKey>(hash, key);
+	}
+
+	/// Like `get()`, but the hash is computed with the hasher policy.
+	/// WARNING: If the entry was not found then the return value is **undefined**.
+	inline TValue get(const TKey &key) const
+	{
+		return get<TKey>(_hash_key(key), key);
+	}
+
+	/// Like `get()`, but with a key of any type the equality policy can compare keys
+	/// with.
+	template <typename TK>
+	inline _if_comparable<TK, TValue> get(hash_type hash, const TK &key) const
+	{
+		TValue value;
+		lookup<TK>(hash, key, value);
+		return value;
+	}
+
+	/// Remove an entry from the hashtable by proving the hash and the key value, in case a
+	/// collision occurs.
+	void remove(hash_type hash, const TKey &key)
+	{
+		remove<TKey>(hash, key);
+	}
+
+	/// Like `remove()`, but the hash is computed with the hasher policy.
+	void remove(const TKey &key)
+	{
+		remove<TKey>(_hash_key(key), key);
+	}
+
+	/// Like `remove()`, but with a key of any type the equality policy can compare keys
+	/// with.
+	template <typename TK>
+	_if_comparable<TK, void> remove(hash_type hash, const TK &key)
+	{
+		uint32_t pos = 0;
+		bool exists = _lookup_pos(_hash(hash), key, pos);
+		if (!exists) {
+			return;
+		}
+
+		_remove_at(pos);
+	}
+
+	/// Returns the number of slots a lookup of the given hash and key has to inspect.
+	/// This is meant for tuning and benchmarking, it walks the probe chain the same way
+	/// `lookup()` does, so it's not any cheaper than a lookup.
+	size_t probe_length(hash_type hash, const TKey &key) const
+	{
+		hash = _hash(hash);
+		uint32_t pos = _home(hash);
+		uint32_t distance = 0;
+
+		while (distance < m_capacity && distance <= hash_policy::max_distance) {
+			if (hash_policy::is_empty(_slot(pos))) {
+				break;
+			}
+
+			if (distance > _get_probe_distance(pos, _slot(pos))) {
+				break;
+			}
+
+			if (_slot(pos) == hash_policy::make(hash, distance) && equality_policy::equal(_key(pos), key)) {
+				break;
+			}
+
+			pos = _next(pos);
+			distance++;
+		}
+
+		return distance + 1;
+	}
+
+	/// Create an iterator for the hashmap. Use `iter_next()` to advance the iteration.
+	iter iter_start() const
+	{
+		iter iter = {};
+		iter.offset = 0;
+		return iter;
+	}
+
+	/// Advance the iterator to the next elements found. Key and value will be written to the
+	/// out parameters `key` and `value` in case a next iteration was possible.
+	/// In that case the function will return true.
+	/// The function will return false when the end was reached.
+	bool iter_next(iter &iter, TKey &key, TValue &value) const
+	{
+		size_t pos = _next_occupied(iter.offset);
+
+		if (pos == m_capacity) {
+			iter.offset = m_capacity;
+			return false;
+		}
+
+		key = _key(pos);
+		value = _value(pos);
+		iter.offset = pos + 1;
+		return true;
+	}
+
+	/// Calls `fn(key, value)` for every entry, with pointers to the key and the value
+	/// inside of the buffer, so nothing gets copied. Values can be modified through the
+	/// pointer, but the map itself must not be modified until `for_each()` returns.
+	/// Empty and deleted slots are skipped a whole group of hashes at a time.
+	template <typename TFn>
+	void for_each(TFn fn)
+	{
+		_for_each_pos([this, &fn](uint32_t pos) {
+			fn((const TKey *) &_key(pos), &_value(pos));
+		});
+	}
+
+	/// Like `for_each()`, but the values are read-only.
+	template <typename TFn>
+	void for_each(TFn fn) const
+	{
+		_for_each_pos([this, &fn](uint32_t pos) {
+			fn((const TKey *) &_key(pos), (const TValue *) &_value(pos));
+		});
+	}
+
+	/// Grows the map into a bigger buffer that starts at the same address as the current
+	/// one, for example after extending the allocation with `mremap()` or by committing
+	/// more pages of a reserved virtual address range.
+	/// The hashes, keys and values regions get relocated back to front and all entries are
+	/// redistributed in a single pass over the table, so no second buffer is needed.
+	/// Tombstones are dropped in the process. Keys and values have to be trivially copyable.
+	/// Returns false and leaves the map untouched if the new buffer can't hold more
+	/// entries than the current one, or if the hash policy limits probe distances (like
+	/// `hash24_distance` and `fingerprint8`) and some entry would end up too far away
+	/// from its home slot with the new capacity.
+	/// This needs a hash policy that stores the full hashes. For other policies use the
+	/// overload that takes a hash function.
+	bool grow_in_place(size_t new_buffer_size)
+	{
+		static_assert(hash_policy::stores_hash, "the hash policy doesn't store full hashes, provide a hash function to grow_in_place()");
+
+		return grow_in_place(new_buffer_size, _stored_hash());
+	}
+
+	/// Grows the map like `grow_in_place()`, but the hashes of the entries get calculated
+	/// again by calling `hash_fn(key)`.
+	template <typename THashFn>
+	bool grow_in_place(size_t new_buffer_size, THashFn hash_fn)
+	{
+		static_assert(std::is_trivially_copyable<TKey>::value && std::is_trivially_copyable<TValue>::value,
+		              "grow_in_place() relocates the regions byte by byte, which needs trivially copyable keys and values");
+
+		size_t old_capacity = m_capacity;
+		size_t new_capacity = capacity_policy::adjust(layout::max_slots(new_buffer_size));
+
+		if (new_capacity <= old_capacity) {
+			return false;
+		}
+
+		if (hash_policy::max_distance < new_capacity) {
+			// The part of the new buffer that isn't used yet holds the counters.
+			uint8_t local_scratch[256];
+			uint8_t *scratch = local_scratch;
+			size_t scratch_size = sizeof(local_scratch);
+			size_t used_size = layout::buffer_size(old_capacity);
+
+			if (new_buffer_size - used_size > scratch_size) {
+				scratch = m_buffer + used_size;
+				scratch_size = new_buffer_size - used_size;
+			}
+
+			if (!_can_rehash(new_capacity, hash_fn, scratch, scratch_size)) {
+				return false;
+			}
+		}
+
+		layout::grow(m_buffer, old_capacity, new_capacity);
+
+		m_capacity = new_capacity;
+		_update_regions();
+
+		// Mark every entry as not yet rehashed. Deleted entries aren't needed anymore.
+		for (size_t i = 0; i < old_capacity; i++) {
+			if (hash_policy::is_empty(_slot(i))) {
+				continue;
+			}
+			if (hash_policy::is_deleted(_slot(i))) {
+				_slot(i) = hash_policy::EMPTY_HASH;
+				continue;
+			}
+			_slot(i) = hash_policy::mark_deleted(_slot(i));
+		}
+
+		for (size_t i = old_capacity; i < new_capacity; i++) {
+			_slot(i) = hash_policy::EMPTY_HASH;
+		}
+
+		m_num_elements = 0;
+
+		// Take every entry that wasn't rehashed yet out of its slot and insert it again.
+		// Inserting can place another entry in this slot which wasn't rehashed yet,
+		// so keep going until the slot is done.
+		for (uint32_t i = 0; i < old_capacity; i++) {
+			while (hash_policy::is_deleted(_slot(i))) {
+				hash_type hash = _pending_hash(i, hash_fn);
+				TKey key = _key(i);
+				TValue value = _value(i);
+
+				_slot(i) = hash_policy::EMPTY_HASH;
+				_insert_rehashing(hash, key, value, hash_fn);
+			}
+		}
+
+		return true;
+	}
+
+	/// Removes all entries and tombstones from the map. Keys and values that aren't
+	/// trivially destructible get destroyed. Since the map doesn't own its buffer it never
+	/// destroys entries on its own, call this before giving up the buffer.
+	void clear()
+	{
+		bool destroy = !std::is_trivially_destructible<TKey>::value || !std::is_trivially_destructible<TValue>::value;
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			if (destroy && !hash_policy::is_empty(_slot(i)) && !hash_policy::is_deleted(_slot(i))) {
+				_destroy_at(i);
+			}
+			_slot(i) = hash_policy::EMPTY_HASH;
+		}
+
+		m_num_elements = 0;
+	}
+
+	/// Calculates the load factor of the map. When the load factor is greater than 0.95
+	/// then `copy()` should be used to relocate the hashmap for better performance.
+	/// `stats()` tells more precisely how much lookups suffer.
+	inline float load_factor() const
+	{
+		return m_num_elements / (float) m_capacity;
+	}
+
+	/// Collects statistics about the slots of the map: the probe distances of the entries,
+	/// tombstones and runs of occupied slots. This reads the whole hashes region, so it
+	/// costs about as much as iterating the map. A growing mean probe distance or a lot of
+	/// tombstones mean it's time to `copy()` the map into a fresh buffer.
+	hash_stats stats() const
+	{
+		hash_stats stats = {};
+
+		stats.capacity = m_capacity;
+		stats.num_elements = m_num_elements;
+
+		uint64_t total_distance = 0;
+		size_t run = 0;
+		size_t first_run = 0;
+		bool seen_empty = false;
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			slot_type slot = _slot(i);
+
+			if (hash_policy::is_empty(slot)) {
+				if (!seen_empty) {
+					first_run = run;
+					seen_empty = true;
+				}
+				run = 0;
+				continue;
+			}
+
+			run++;
+			if (run > stats.longest_run) {
+				stats.longest_run = run;
+			}
+
+			if (hash_policy::is_deleted(slot)) {
+				stats.num_tombstones++;
+				continue;
+			}
+
+			uint32_t distance = _get_probe_distance((uint32_t) i, slot);
+			total_distance += distance;
+
+			if (distance > stats.max_probe_distance) {
+				stats.max_probe_distance = distance;
+			}
+
+			stats.probe_distance_histogram[distance < hash_stats::HISTOGRAM_SIZE ? distance : hash_stats::HISTOGRAM_SIZE - 1]++;
+		}
+
+		// The run at the end of the table continues at its start.
+		if (seen_empty && run + first_run > stats.longest_run) {
+			stats.longest_run = run + first_run;
+		}
+
+		if (m_capacity > 0) {
+			stats.load_factor = m_num_elements / (float) m_capacity;
+			stats.effective_load_factor = (m_num_elements + stats.num_tombstones) / (float) m_capacity;
+		}
+
+		if (m_num_elements > 0) {
+			stats.mean_probe_distance = total_distance / (float) m_num_elements;
+		}
+
+		this->_read_probe_counters(stats);
+
+		return stats;
+	}
+
+	/// Resets the lookup counters of `stats()`.
+	void reset_probe_counters()
+	{
+		this->_reset_probe_counters();
+	}
+
+	/// Creates a new hashmap using a different buffer. All the entries of the
+	/// current map will be inserted into the new map. The entries are copied, so keys
+	/// and values that need to be destroyed have to be cleared from this map afterwards.
+	/// This needs a hash policy that stores the full hashes. For other policies use the
+	/// overload that takes a hash function.
+	hashmap copy(size_t buffer_size, void *buffer) const
+	{
+		static_assert(hash_policy::stores_hash, "the hash policy doesn't store full hashes, provide a hash function to copy()");
+
+		hashmap new_hashmap = hashmap::create(buffer_size, buffer);
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			if (hash_policy::is_empty(_slot(i))) {
+				continue;
+			}
+			if (hash_policy::is_deleted(_slot(i))) {
+				continue;
+			}
+
+			new_hashmap.insert(hash_policy::hash(_slot(i)), _key(i), _value(i));
+		}
+
+		return new_hashmap;
+
+	}
+
+	/// Creates a new hashmap using a different buffer like `copy()`, but the hashes of
+	/// the entries get calculated again by calling `hash_fn(key)`.
+	/// This works with every hash policy, including the ones that don't store the full
+	/// hashes, like `cf::fingerprint8`.
+	template <typename THashFn>
+	hashmap copy(size_t buffer_size, void *buffer, THashFn hash_fn) const
+	{
+		hashmap new_hashmap = hashmap::create(buffer_size, buffer);
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			if (hash_policy::is_empty(_slot(i))) {
+				continue;
+			}
+			if (hash_policy::is_deleted(_slot(i))) {
+				continue;
+			}
+
+			new_hashmap.insert(_hash(hash_fn(_key(i))), _key(i), _value(i));
+		}
+
+		return new_hashmap;
+	}
+
+	/// Creates a new hashmap using a different buffer like `copy()`, with up to
+	/// `num_threads` tasks that each fill a part of the new table. `executor` runs the
+	/// tasks and `scratch` holds the sorted indices of the entries like for
+	/// `bulk_build()`, it needs `build_scratch_size(num_elements())` bytes.
+	/// This needs a hash policy that stores the full hashes. For other policies use the
+	/// overload that takes a hash function.
+	template <typename TExecutor>
+	hashmap copy(size_t buffer_size, void *buffer, size_t scratch_size, void *scratch, size_t num_threads, TExecutor executor) const
+	{
+		static_assert(hash_policy::stores_hash, "the hash policy doesn't store full hashes, provide a hash function to copy()");
+
+		return copy(buffer_size, buffer, _stored_hash(), scratch_size, scratch, num_threads, executor);
+	}
+
+	/// Like the parallel `copy()`, but the hashes of the entries get calculated again by
+	/// calling `hash_fn(key)`. Sorting the entries and inserting them each hash every
+	/// key, so every key gets hashed three times, or once when the entries get inserted
+	/// on the calling thread. Expensive hash functions are better off with a policy that
+	/// stores the full hashes.
+	template <typename THashFn, typename TExecutor>
+	hashmap copy(size_t buffer_size, void *buffer, THashFn hash_fn, size_t scratch_size, void *scratch, size_t num_threads, TExecutor executor) const
+	{
+		hashmap new_hashmap = _create_parallel(buffer_size, buffer, num_threads, executor);
+
+		_map_source<THashFn> source = { this, hash_fn };
+		new_hashmap._build(source, scratch_size, scratch, num_threads, executor);
+
+		return new_hashmap;
+	}
+
+	/// The number of elements in this hash map.
+	size_t num_elements() const
+	{
+		return m_num_elements;
+	}
 
 	/// The capacity of how many elements *could* be held in this map.
 	size_t capacity() const
@@ -331,6 +1764,283 @@ public:
 	}
 };
 
+/// A `cf::hashmap` with `N` slots that carries its buffer inside of itself, for maps
+/// whose size is known up front. The capacity is a compile-time constant, so finding
+/// a slot compiles down to a mask (if `N` is a power of two) or a multiplication and no
+/// division is left. Everything else works like with `cf::hashmap`, the map can be
+/// used right after it was constructed.
+/// The map can't be copied, because the hashmap points into its own storage.
+template <typename TKey, typename TValue, size_t N, typename TTraits = hash_traits>
+struct static_hashmap
+	: private inline_buffer<hashmap<TKey, TValue, hash_traits_fixed<TTraits, N> >::buffer_size(N),
+	                        hashmap<TKey, TValue, hash_traits_fixed<TTraits, N> >::layout::alignment()>,
+	  public hashmap<TKey, TValue, hash_traits_fixed<TTraits, N> > {
+
+	typedef hashmap<TKey, TValue, hash_traits_fixed<TTraits, N> > map_type;
+
+	static_hashmap()
+		: map_type(map_type::create(sizeof(this->m_storage), this->m_storage))
+	{
+	}
+
+	static_hashmap(const static_hashmap &) = delete;
+	static_hashmap &operator=(const static_hashmap &) = delete;
+
+	/// The number of slots, known at compile time.
+	static constexpr size_t capacity()
+	{
+		return N;
+	}
+
+	/// The number of bytes the map takes up including its storage.
+	static constexpr size_t storage_size()
+	{
+		return map_type::buffer_size(N);
+	}
+};
+
+/// A hashmap that can be resized without stalling on a single big rehash.
+/// `begin_resize()` hands the map a new buffer, after that the entries of the old buffer
+/// get migrated bit by bit: every `set()`, `lookup()` and `remove()` migrates
+/// `migration_slots` slots of the old table, and `migrate_step()` can be used to drive
+/// the migration from an idle loop. Until the migration is done, lookups check both
+/// tables. Once `is_migrating()` returns false the old buffer isn't used anymore.
+/// This needs a hash policy that stores the full hashes.
+template <typename TKey, typename TValue, typename TTraits = hash_traits>
+struct incremental_hashmap {
+
+private:
+	typedef hashmap<TKey, TValue, TTraits> map_type;
+	typedef typename map_type::hash_policy hash_policy;
+	typedef typename map_type::slot_type slot_type;
+
+	static_assert(hash_policy::stores_hash, "incremental_hashmap needs a hash policy that stores full hashes");
+
+	map_type m_map;
+
+	map_type m_old;
+
+	size_t m_migrate_pos;
+
+	bool m_migrating;
+
+public:
+
+	typedef typename map_type::hash_type hash_type;
+
+	/// An iterator for iterating over key-value pairs. Use `iter_start()` to acquire
+	/// such an iterator. Use `iter_next()` to advance the iteration.
+	struct iter {
+		typename map_type::iter current;
+		typename map_type::iter old;
+	};
+
+	/// The size of a buffer that can hold at least `num_elements` entries.
+	static constexpr size_t buffer_size(size_t num_elements)
+	{
+		return map_type::buffer_size(num_elements);
+	}
+
+	/// Constructs a new map that uses `buffer` as the storage, like `hashmap::create()`.
+	static incremental_hashmap create(size_t buffer_size, void *buffer)
+	{
+		incremental_hashmap map = {};
+
+		map.m_map = map_type::create(buffer_size, buffer);
+		map.m_migrate_pos = 0;
+		map.m_migrating = false;
+
+		return map;
+	}
+
+	/// Starts moving the map into a new buffer. New entries go into the new buffer
+	/// right away, the existing ones get migrated incrementally.
+	/// Returns false if a migration is still in progress, call `migrate_step()` until
+	/// `is_migrating()` returns false in that case. Also returns false if the new buffer
+	/// can't hold the entries of the map.
+	bool begin_resize(size_t buffer_size, void *buffer)
+	{
+		if (m_migrating) {
+			return false;
+		}
+
+		map_type map = map_type::create(buffer_size, buffer);
+		if (map.capacity() < m_map.num_elements()) {
+			return false;
+		}
+
+		m_old = m_map;
+		m_map = map;
+		m_migrate_pos = 0;
+		m_migrating = true;
+
+		return true;
+	}
+
+	/// Migrates up to `num_slots` slots of the old table into the new one.
+	/// Returns the number of slots that are left to migrate, 0 once the migration is
+	/// done. Entries that don't fit into the new table stay in the old one, so if that
+	/// number stops going down the new table got filled up with new entries.
+	size_t migrate_step(size_t num_slots)
+	{
+		if (!m_migrating) {
+			return 0;
+		}
+
+		size_t end = m_migrate_pos + num_slots;
+		if (end > m_old.m_capacity) {
+			end = m_old.m_capacity;
+		}
+
+		for (size_t i = m_migrate_pos; i < end; i++) {
+			if (hash_policy::is_empty(m_old._slot(i)) || hash_policy::is_deleted(m_old._slot(i))) {
+				continue;
+			}
+
+			hash_type hash = hash_policy::hash(m_old._slot(i));
+			if (!m_map._insert_at(m_map._home(hash), 0, hash, static_cast<TKey &&>(m_old._key(i)), static_cast<TValue &&>(m_old._value(i)))) {
+				// The slot gets migrated again by the next step.
+				end = i;
+				break;
+			}
+
+			// Leave a tombstone so the probe chains of the old table stay intact for
+			// the entries that weren't migrated yet.
+			m_old._destroy_at((uint32_t) i);
+			m_old._slot(i) = hash_policy::mark_deleted(m_old._slot(i));
+			m_old.m_num_elements--;
+		}
+
+		m_migrate_pos = end;
+
+		size_t remaining = m_old.m_capacity - m_migrate_pos;
+
+		if (remaining == 0) {
+			m_migrating = false;
+			m_old = map_type();
+		}
+
+		return remaining;
+	}
+
+	/// Whether a migration started by `begin_resize()` is still in progress.
+	bool is_migrating() const
+	{
+		return m_migrating;
+	}
+
+	/// Associate a key with a value, like `hashmap::set()`.
+	/// If the new table filled up during a migration, an entry that wasn't migrated yet
+	/// gets its value updated in the old table instead.
+	void set(hash_type hash, const TKey &key, const TValue &value)
+	{
+		if (m_migrating) {
+			migrate_step(TTraits::migration_slots);
+		}
+
+		if (!m_migrating) {
+			m_map.set(hash, key, value);
+			return;
+		}
+
+		bool inserted = false;
+		TValue *existing = m_map._find_or_insert(map_type::_hash(hash), key, value, inserted);
+
+		if (existing && !inserted) {
+			*existing = value;
+		} else if (existing) {
+			// The new value is the only one that counts from now on.
+			m_old.remove(hash, key);
+		} else if (TValue *old = m_old.find(hash, key)) {
+			*old = value;
+		}
+	}
+
+	/// Lookup a value, like `hashmap::lookup()`. While a resize is in progress, this
+	/// also migrates a few slots.
+	bool lookup(hash_type hash, const TKey &key, TValue &value)
+	{
+		if (m_migrating) {
+			migrate_step(TTraits::migration_slots);
+		}
+
+		return static_cast<const incremental_hashmap *>(this)->lookup(hash, key, value);
+	}
+
+	/// Lookup a value without migrating any slots.
+	bool lookup(hash_type hash, const TKey &key, TValue &value) const
+	{
+		if (m_map.lookup(hash, key, value)) {
+			return true;
+		}
+
+		return m_migrating && m_old.lookup(hash, key, value);
+	}
+
+	/// Get the value associated with the given hash and key.
+	/// WARNING: If the entry was not found then the return value is **undefined**.
+	inline TValue get(hash_type hash, const TKey &key)
+	{
+		TValue value;
+		lookup(hash, key, value);
+		return value;
+	}
+
+	/// Remove an entry, like `hashmap::remove()`.
+	void remove(hash_type hash, const TKey &key)
+	{
+		if (m_migrating) {
+			migrate_step(TTraits::migration_slots);
+		}
+
+		m_map.remove(hash, key);
+
+		if (m_migrating) {
+			m_old.remove(hash, key);
+		}
+	}
+
+	/// Create an iterator for the map. Use `iter_next()` to advance the iteration.
+	iter iter_start() const
+	{
+		iter iter = {};
+		iter.current = m_map.iter_start();
+		iter.old = m_old.iter_start();
+		return iter;
+	}
+
+	/// Advance the iterator, like `hashmap::iter_next()`. Entries that weren't migrated
+	/// yet come after all the entries of the new table.
+	/// Don't modify the map while iterating, migrating entries moves them between the
+	/// two tables.
+	bool iter_next(iter &iter, TKey &key, TValue &value) const
+	{
+		if (m_map.iter_next(iter.current, key, value)) {
+			return true;
+		}
+
+		return m_migrating && m_old.iter_next(iter.old, key, value);
+	}
+
+	/// The load factor of the new table.
+	inline float load_factor() const
+	{
+		return m_map.load_factor();
+	}
+
+	/// The number of elements in both tables.
+	size_t num_elements() const
+	{
+		return m_map.num_elements() + (m_migrating ? m_old.num_elements() : 0);
+	}
+
+	/// The capacity of the new table.
+	size_t capacity() const
+	{
+		return m_map.capacity();
+	}
+};
+
 }
 
 #endif
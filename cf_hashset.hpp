@@ -4,37 +4,74 @@
 
 ///
 /// This is a single-header library that provides a chache-friend hash set that
-/// uses open addressing with robinhood hashing.
+/// uses open addressing with robinhood hashing. Its policies and hash helpers come
+/// from cf_hash_policies.hpp, which is shared with cf_hashmap.hpp.
 ///
 #ifndef CF_HASHSET_HPP
 #define CF_HASHSET_HPP
 
 #include <stddef.h>
 #include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#include "cf_hash_policies.hpp"
 
 namespace cf {
 
+/// Calculates the size of a buffer for a hashset with the default traits that can hold
+/// `num_elements` elements, including the padding between the regions.
 #define CF_HASHSET_GET_BUFFER_SIZE(key_type, num_elements) \
-	((sizeof(uint32_t) + sizeof(key_type)) * num_elements)
+	(cf::hashset<key_type>::buffer_size(num_elements))
+
+/// Calculates the size of a buffer for a hashset using the `capacity_pow2` policy
+/// that can hold at least `num_elements` elements.
+#define CF_HASHSET_GET_BUFFER_SIZE_POW2(key_type, num_elements) \
+	CF_HASHSET_GET_BUFFER_SIZE(key_type, cf::pow2_ceil(num_elements))
+
+/// Calculates the size of a buffer for a hashset with the given traits that can hold
+/// at least `num_elements` elements.
+#define CF_HASHSET_GET_BUFFER_SIZE_TRAITS(traits, key_type, num_elements) \
+	(cf::hashset<key_type, traits>::buffer_size(num_elements))
 
 /// A hashset type that uses open addressing with robinhood hashing.
 /// The hashset uses 2 different regions of memory: hashes and values.
 /// Those regions are located next to each other in a buffer in a Struct-of-Arrays
 /// kind of fashion.
-/// The hashes are the hashes provided by the user. This hashset doesn't do any hashing itself.
+/// The hashes are the hashes provided by the user, or computed by the `hasher_policy` of the
+/// traits for the overloads that don't take a hash.
 /// The values region contains the values. They are used to resolve collisions and check for existance.
-template <typename T>
-struct hashset {
+/// The values region starts on a cache line, so it is aligned for any value type as long
+/// as the buffer starts on a cache line too.
+/// The `TTraits` parameter selects the policies used by the set, see `cf::hash_traits`.
+template <typename T, typename TTraits = hash_traits>
+struct hashset : private probe_counters<TTraits::count_probes> {
 
 private:
+	template <typename, size_t, typename>
+	friend struct static_hashset;
+
+	typedef typename TTraits::capacity_policy capacity_policy;
+	typedef typename TTraits::hash_policy hash_policy;
+	typedef typename hash_policy::slot_type slot_type;
+	typedef typename TTraits::equality_policy equality_policy;
+	typedef typename TTraits::hasher_policy hasher_policy;
+
+	// `TResult` if values can be compared with a `TV`, otherwise the function using this
+	// drops out of overload resolution. Numbers and pointers that convert to a `T` get
+	// converted like before, so literals don't end up being compared as another type.
+	template <typename TV, typename TResult>
+	using _if_comparable = typename result_if_valid<
+		typename std::enable_if<std::is_same<TV, T>::value || !(std::is_scalar<TV>::value && std::is_convertible<const TV &, T>::value), TResult>::type,
+		decltype(equality_policy::equal(std::declval<const T &>(), std::declval<const TV &>()))>::type;
+
 	size_t m_num_elements;
 
 	size_t m_capacity;
 
-	uint8_t *m_buffer;
-
-	static const uint32_t EMPTY_HASH = 0;
-	static const uint32_t DELETED_HASH_BIT = 1 << 31;
+	// Both regions of the buffer, computed once in `create()`. They never overlap.
+	slot_type *__restrict m_hashes;
+	T *__restrict m_values;
 
 	template <typename A>
 	static void _swap(A &a, A &b) {
@@ -43,79 +80,171 @@ private:
 		b = tmp;
 	}
 
-	// We want only hashes != 0 since we use that for detecting empty
-	// entries.
-	// The leftmost bit indicates that the entry was deleted in the past.
-	// We can't use just a "deleted value" because otherwise we lose information
-	// about the previous probe distance
-	static uint32_t _hash(uint32_t hash)
+public:
+
+	/// The type of the hashes the caller provides, depends on the hash policy.
+	typedef typename hash_policy::hash_type hash_type;
+
+private:
+
+	static hash_type _hash(hash_type hash)
 	{
-		if (hash == EMPTY_HASH) {
-			hash = EMPTY_HASH + 1;
-		} else if (hash & DELETED_HASH_BIT) {
-			hash &= ~DELETED_HASH_BIT;
+		return hash_policy::normalize(hash);
+	}
+
+	// The hash of a value for the overloads that don't take one.
+	static hash_type _hash_value(const T &value)
+	{
+		return fold_hash<hash_type>(hasher_policy::hash(value));
+	}
+
+	static constexpr size_t _values_offset(size_t capacity)
+	{
+		return region_start<T>(sizeof(slot_type) * capacity);
+	}
+
+	static constexpr size_t _alignment()
+	{
+		return region_alignment<slot_type>() > region_alignment<T>() ? region_alignment<slot_type>() : region_alignment<T>();
+	}
+
+	// The largest number of slots that fit into the buffer, padding included.
+	static size_t _max_slots(size_t buffer_size)
+	{
+		size_t num_slots = buffer_size / (sizeof(slot_type) + sizeof(T));
+
+		while (num_slots > 0 && _values_offset(num_slots) + sizeof(T) * num_slots > buffer_size) {
+			num_slots--;
 		}
 
-		return hash;
+		return num_slots;
 	}
 
-	uint32_t _get_probe_distance(uint32_t pos, uint32_t hash) const
+	inline uint32_t _home(hash_type hash) const
 	{
-		hash = hash & ~DELETED_HASH_BIT;
+		return capacity_policy::index(hash, m_capacity);
+	}
 
-		uint32_t ideal_pos = hash % m_capacity;
+	inline uint32_t _next(uint32_t pos) const
+	{
+		return capacity_policy::next(pos, m_capacity);
+	}
 
-		return pos - ideal_pos;
+	uint32_t _get_probe_distance(uint32_t pos, slot_type slot) const
+	{
+		if (hash_policy::stores_distance) {
+			return hash_policy::distance(slot);
+		}
+
+		uint32_t ideal_pos = _home(hash_policy::hash(slot));
+
+		return capacity_policy::distance(pos, ideal_pos, m_capacity);
 	}
 
-	bool _lookup_pos(uint32_t hash, const T &value, uint32_t &pos) const
+	template <typename TV>
+	bool _lookup_pos(hash_type hash, const TV &value, uint32_t &pos) const
 	{
-		pos = hash % m_capacity;
+		pos = _home(hash);
 		uint32_t distance = 0;
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		T *values = (T *) (m_buffer + m_capacity * sizeof(uint32_t));
+		slot_type *hashes = m_hashes;
+		T *values = m_values;
 
-		while (distance < m_capacity) {
-			if (hashes[pos] == EMPTY_HASH) {
-				return false;
+		while (distance < m_capacity && distance <= hash_policy::max_distance) {
+
+			if (pos + hash_policy::group_width > m_capacity) {
+				// Not enough slots left for a whole group before the table wraps
+				// around, so take a single step instead.
+				if (hash_policy::is_empty(hashes[pos])) {
+					this->_count_lookup(distance + 1);
+					return false;
+				}
+
+				if (distance > _get_probe_distance(pos, hashes[pos])) {
+					this->_count_lookup(distance + 1);
+					return false;
+				}
+
+				if (hashes[pos] == hash_policy::make(hash, distance) && equality_policy::equal(values[pos], value)) {
+					this->_count_lookup(distance + 1);
+					return true;
+				}
+
+				pos = _next(pos);
+				distance++;
+				continue;
 			}
 
-			if (distance > _get_probe_distance(pos, hashes[pos])) {
+			uint32_t empty = 0;
+			uint32_t match = hash_policy::match(hashes + pos, hash, distance, empty);
+
+			// The chain ends at the first empty slot, matches after it are
+			// part of a different chain.
+			if (empty) {
+				match &= hash_group::below_first(empty);
+			}
+
+			// Only the candidate lanes need to touch the values region.
+			while (match) {
+				uint32_t lane = hash_group::first(match);
+				if (equality_policy::equal(values[pos + lane], value)) {
+					this->_count_lookup(distance + lane + 1);
+					pos += lane;
+					return true;
+				}
+				match &= match - 1;
+			}
+
+			if (empty) {
+				this->_count_lookup(distance + hash_group::first(empty) + 1);
 				return false;
 			}
 
-			if (hashes[pos] == hash && values[pos] == value) {
-				return true;
+			// Robin hood ordering: if the last entry of the group is closer to its
+			// ideal position than we would be, our entry can't come after it.
+			uint32_t last = pos + hash_policy::group_width - 1;
+			distance += hash_policy::group_width - 1;
+			if (distance > _get_probe_distance(last, hashes[last])) {
+				this->_count_lookup(distance + 1);
+				return false;
 			}
 
-			pos = (pos + 1) % m_capacity;
+			pos = _next(last);
 			distance++;
 		}
 
+		this->_count_lookup(distance);
 		return false;
 	}
 
-	void _insert(uint32_t hash, const T &value)
+	void _insert(hash_type hash, const T &value)
 	{
 		if (m_num_elements == m_capacity) {
 			// if this is the case then this will just keep trying to
 			// swap stuff around, never terminating.
 			return;
 		}
+
+		if (hash_policy::max_distance < m_capacity && !_can_insert(hash)) {
+			// some entry would end up further away from its ideal position
+			// than the hash policy can store.
+			return;
+		}
+
 		uint32_t distance = 0;
-		uint32_t pos = hash % m_capacity;
+		uint32_t pos = _home(hash);
 
+		slot_type slot = hash_policy::make(hash, 0);
 		T _value = value;
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		T *values = (T *) (m_buffer + sizeof(uint32_t) * m_capacity);
+		slot_type *hashes = m_hashes;
+		T *values = m_values;
 
 		while (distance < m_capacity) {
 
 			// An empty slot, put our stuff in there, then we're done!
-			if (hashes[pos] == EMPTY_HASH) {
-				hashes[pos] = hash;
+			if (hash_policy::is_empty(hashes[pos])) {
+				hashes[pos] = hash_policy::with_distance(slot, distance);
 				values[pos] = _value;
 				m_num_elements++;
 				return;
@@ -125,10 +254,10 @@ private:
 			if (exiting_distance < distance) {
 				// we found a slot that should be further to the right
 
-				if (hashes[pos] & DELETED_HASH_BIT) {
+				if (hash_policy::is_deleted(hashes[pos])) {
 					// buuuut it was deleted so we can use it
 
-					hashes[pos] = hash;
+					hashes[pos] = hash_policy::with_distance(slot, distance);
 					values[pos] = _value;
 					m_num_elements++;
 					return;
@@ -136,15 +265,307 @@ private:
 
 				// swap out the entry and now operate on the other value
 				// that should be further to the right
-				_swap(hash, hashes[pos]);
+				slot = hash_policy::with_distance(slot, distance);
+				_swap(slot, hashes[pos]);
 				_swap(_value, values[pos]);
 				distance = exiting_distance;
 			}
 
-			pos = (pos + 1) % m_capacity;
+			pos = _next(pos);
+			distance++;
+		}
+	}
+
+	// Walks the probe chain like an insert would, without modifying anything, to find
+	// out if all displaced entries stay within the maximum probe distance.
+	bool _can_insert(hash_type hash) const
+	{
+		uint32_t distance = 0;
+		uint32_t pos = _home(hash);
+
+		slot_type *hashes = m_hashes;
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			if (distance > hash_policy::max_distance) {
+				return false;
+			}
+
+			if (hash_policy::is_empty(hashes[pos])) {
+				return true;
+			}
+
+			uint32_t existing_distance = _get_probe_distance(pos, hashes[pos]);
+			if (existing_distance < distance) {
+				if (hash_policy::is_deleted(hashes[pos])) {
+					return true;
+				}
+				distance = existing_distance;
+			}
+
+			pos = _next(pos);
 			distance++;
 		}
+
+		return false;
+	}
+	void _prefetch_home(hash_type hash) const
+	{
+		uint32_t pos = _home(hash);
+
+		hash_group::prefetch(m_hashes + pos);
+		hash_group::prefetch(m_values + pos);
+	}
+
+	// Calls `fn(pos)` for every slot in `[begin, end)` that holds a live entry. Whole
+	// groups of hashes are checked at once, so sparse tables don't cost a branch per
+	// empty slot.
+	template <typename TFn>
+	void _for_each_pos(size_t begin, size_t end, TFn fn) const
+	{
+		slot_type *hashes = m_hashes;
+		size_t pos = begin;
+
+		while (pos < end) {
+			if (pos + hash_policy::group_width > end) {
+				if (!hash_policy::is_empty(hashes[pos]) && !hash_policy::is_deleted(hashes[pos])) {
+					fn((uint32_t) pos);
+				}
+				pos++;
+				continue;
+			}
+
+			uint32_t live = hash_policy::occupied(hashes + pos);
+			while (live) {
+				fn((uint32_t) pos + hash_group::first(live));
+				live &= live - 1;
+			}
+
+			pos += hash_policy::group_width;
+		}
 	}
+
+	template <typename TFn>
+	void _for_each_pos(TFn fn) const
+	{
+		_for_each_pos(0, m_capacity, fn);
+	}
+
+	// Like `_for_each_pos()`, but before an entry gets passed to `fn`, the home slots of
+	// the entries after it in `other` get prefetched, so looking them up in `other`
+	// doesn't wait for one cache miss after another.
+	template <typename TFn>
+	void _for_each_pos_prefetched(const hashset &other, size_t begin, size_t end, TFn fn) const
+	{
+		static const size_t WINDOW = TTraits::prefetch_distance < 64 ? TTraits::prefetch_distance : 64;
+
+		if (WINDOW == 0) {
+			_for_each_pos(begin, end, fn);
+			return;
+		}
+
+		const slot_type *hashes = m_hashes;
+
+		uint32_t pending[WINDOW == 0 ? 1 : WINDOW];
+		size_t num_pending = 0;
+		size_t oldest = 0;
+
+		_for_each_pos(begin, end, [&](uint32_t pos) {
+			other._prefetch_home(hash_policy::hash(hashes[pos]));
+
+			if (num_pending < WINDOW) {
+				pending[num_pending++] = pos;
+				return;
+			}
+
+			fn(pending[oldest]);
+			pending[oldest] = pos;
+			oldest = oldest + 1 == WINDOW ? 0 : oldest + 1;
+		});
+
+		for (size_t i = 0; i < num_pending; i++) {
+			fn(pending[(oldest + i) % num_pending]);
+		}
+	}
+
+	// Whether the entry at `pos` is an element of `other`. The stored hash is used as it
+	// is, it was normalized when the entry got inserted.
+	bool _in(const hashset &other, uint32_t pos) const
+	{
+		uint32_t other_pos = 0;
+		return other._lookup_pos(hash_policy::hash(m_hashes[pos]), m_values[pos], other_pos);
+	}
+
+	// Adds the entry at `pos` to `out` unless it's in there already. Returns false if it
+	// wasn't in `out` and didn't fit.
+	bool _add_to(hashset &out, uint32_t pos) const
+	{
+		hash_type hash = hash_policy::hash(m_hashes[pos]);
+		uint32_t out_pos = 0;
+
+		if (out._lookup_pos(hash, m_values[pos], out_pos)) {
+			return true;
+		}
+
+		size_t before = out.m_num_elements;
+		out._insert(hash, m_values[pos]);
+
+		return out.m_num_elements != before;
+	}
+
+	// Adds every entry of this set that is (`keep_found`) or isn't in `other` to `out`.
+	bool _filter_into(const hashset &other, hashset &out, bool keep_found) const
+	{
+		bool complete = true;
+
+		_for_each_pos_prefetched(other, 0, m_capacity, [&](uint32_t pos) {
+			if (_in(other, pos) == keep_found) {
+				complete &= _add_to(out, pos);
+			}
+		});
+
+		return complete;
+	}
+
+	// How many slots of the source set a task of the parallel set operations checks
+	// in one round. The results of a round are kept in a bit mask on the stack.
+	static const size_t PARALLEL_ROUND_SLOTS = 2048;
+	static const size_t MAX_PARALLEL_TASKS = 64;
+
+	// Whether every entry of this set in `[begin, end)` is in `other`. Stops after the
+	// first round of slots that has an entry missing in `other`.
+	bool _all_in(const hashset &other, size_t begin, size_t end) const
+	{
+		bool all = true;
+
+		for (size_t round = begin; round < end && all; round += PARALLEL_ROUND_SLOTS) {
+			size_t round_end = round + PARALLEL_ROUND_SLOTS < end ? round + PARALLEL_ROUND_SLOTS : end;
+
+			_for_each_pos_prefetched(other, round, round_end, [&](uint32_t pos) {
+				all = all && _in(other, pos);
+			});
+		}
+
+		return all;
+	}
+
+	// Like `_filter_into()`, but the lookups in `other` are split up between
+	// `num_threads` tasks. Inserting into `out` stays serial.
+	template <typename TExecutor>
+	bool _filter_into(const hashset &other, hashset &out, bool keep_found, size_t num_threads, TExecutor &executor) const
+	{
+		static const size_t WORDS = PARALLEL_ROUND_SLOTS / 32;
+
+		if (num_threads > MAX_PARALLEL_TASKS) {
+			num_threads = MAX_PARALLEL_TASKS;
+		}
+
+		if (num_threads <= 1 || m_capacity <= PARALLEL_ROUND_SLOTS) {
+			return _filter_into(other, out, keep_found);
+		}
+
+		uint32_t keep[MAX_PARALLEL_TASKS][WORDS];
+		bool complete = true;
+
+		for (size_t base = 0; base < m_capacity; base += num_threads * PARALLEL_ROUND_SLOTS) {
+			executor(num_threads, [&](size_t task) {
+				uint32_t *bits = keep[task];
+				for (size_t w = 0; w < WORDS; w++) {
+					bits[w] = 0;
+				}
+
+				size_t begin = base + task * PARALLEL_ROUND_SLOTS;
+				size_t end = begin + PARALLEL_ROUND_SLOTS < m_capacity ? begin + PARALLEL_ROUND_SLOTS : m_capacity;
+
+				if (begin >= end) {
+					return;
+				}
+
+				_for_each_pos_prefetched(other, begin, end, [&](uint32_t pos) {
+					if (_in(other, pos) == keep_found) {
+						size_t offset = pos - begin;
+						bits[offset / 32] |= (uint32_t) 1 << (offset % 32);
+					}
+				});
+			});
+
+			for (size_t task = 0; task < num_threads; task++) {
+				size_t begin = base + task * PARALLEL_ROUND_SLOTS;
+
+				for (size_t w = 0; w < WORDS; w++) {
+					uint32_t bits = keep[task][w];
+					while (bits) {
+						uint32_t pos = (uint32_t) (begin + w * 32 + hash_group::first(bits));
+						complete &= _add_to(out, pos);
+						bits &= bits - 1;
+					}
+				}
+			}
+		}
+
+		return complete;
+	}
+
+	// The first slot at or after `pos` that holds a live entry, or the capacity if
+	// there is none.
+	size_t _next_occupied(size_t pos) const
+	{
+		slot_type *hashes = m_hashes;
+
+		while (pos < m_capacity) {
+			if (pos + hash_policy::group_width > m_capacity) {
+				if (!hash_policy::is_empty(hashes[pos]) && !hash_policy::is_deleted(hashes[pos])) {
+					return pos;
+				}
+				pos++;
+				continue;
+			}
+
+			uint32_t live = hash_policy::occupied(hashes + pos);
+			if (live) {
+				return pos + hash_group::first(live);
+			}
+
+			pos += hash_policy::group_width;
+		}
+
+		return m_capacity;
+	}
+
+	void _remove_at(uint32_t pos)
+	{
+		slot_type *hashes = m_hashes;
+		m_num_elements--;
+
+		if (!TTraits::backward_shift_deletion) {
+			hashes[pos] = hash_policy::mark_deleted(hashes[pos]);
+			return;
+		}
+
+		T *values = m_values;
+
+		// Move every following entry of the chain one slot back until we hit an
+		// empty slot or an entry that already sits in its ideal position.
+		uint32_t next = _next(pos);
+		for (size_t i = 1; i < m_capacity; i++) {
+			if (hash_policy::is_empty(hashes[next])) {
+				break;
+			}
+
+			uint32_t distance = _get_probe_distance(next, hashes[next]);
+			if (distance == 0) {
+				break;
+			}
+
+			hashes[pos] = hash_policy::with_distance(hashes[next], distance - 1);
+			values[pos] = values[next];
+
+			pos = next;
+			next = _next(next);
+		}
+
+		hashes[pos] = hash_policy::EMPTY_HASH;
+	}
+
 public:
 	/// An iterator for iterating over the values. Use `iter_start()` to acquire
 	/// such an iterator. Use `iter_next()` to advance the iteration.
@@ -152,33 +573,60 @@ public:
 		size_t offset;
 	};
 
+	/// The size of a buffer that can hold at least `num_elements` values with the
+	/// policies of this hashset type.
+	static constexpr size_t buffer_size(size_t num_elements)
+	{
+		return _values_offset(capacity_policy::slots_for(num_elements)) + sizeof(T) * capacity_policy::slots_for(num_elements);
+	}
+
 	/// This functions constructs a new hashet value.
 	/// The buffer is a chunk of memory that will be used as the storage. That
 	/// buffer should probably be created/sized by using the `CF_HASHSET_GET_BUFFER_SIZE` macro.
 	/// Don't modify the contents of the buffer after handing it to a hashset.
 	static hashset create(size_t buffer_size, void *buffer)
 	{
-		hashset<T> set = {};
+		hashset set = {};
 
-		set.m_buffer = (uint8_t *) buffer;
 		set.m_num_elements = 0;
-		set.m_capacity = (size_t)(buffer_size / (sizeof(T) + sizeof(uint32_t)));
+		set.m_capacity = capacity_policy::adjust(_max_slots(buffer_size));
 
 		size_t capacity = set.m_capacity;
-		uint32_t *hashes = (uint32_t *) set.m_buffer;
+		set.m_hashes = (slot_type *) buffer;
+		set.m_values = (T *) ((uint8_t *) buffer + _values_offset(capacity));
+
+		slot_type *hashes = set.m_hashes;
 
 		// Set the flags os that every element is considered empty
 		for (size_t i = 0; i < capacity; i++) {
-			hashes[i] = EMPTY_HASH;
+			hashes[i] = hash_policy::EMPTY_HASH;
 		}
 
 		return set;
 	}
 
-	/// Inserts a value into the hashset. Since this hashset doesn't perform any hashing
-	/// itself, the caller has to provide the hash value.
+	/// Like `create()`, but checks the buffer first. Returns false and leaves `set`
+	/// untouched if the buffer doesn't start on a cache line (or on a multiple of the
+	/// alignment of `T` if that is bigger) or can't hold a single value. Starting on a cache
+	/// line makes sure both regions do as well.
+	static bool create(size_t buffer_size, void *buffer, hashset &set)
+	{
+		if ((uintptr_t) buffer % _alignment() != 0) {
+			return false;
+		}
+
+		if (capacity_policy::adjust(_max_slots(buffer_size)) == 0) {
+			return false;
+		}
+
+		set = create(buffer_size, buffer);
+		return true;
+	}
+
+	/// Inserts a value into the hashset. The hash is computed by the caller,
+	/// `insert(value)` computes it with the hasher policy instead.
 	/// The value is used for checking for existance as well as collision resolution.
-	void insert(uint32_t hash, const T &value)
+	void insert(hash_type hash, const T &value)
 	{
 		hash = _hash(hash);
 		uint32_t pos = 0;
@@ -191,17 +639,77 @@ public:
 		_insert(hash, value);
 	}
 
+	/// Like `insert()`, but the hash is computed from the value with the `hasher_policy`
+	/// of the traits (`cf::hasher` by default), so the caller doesn't have to hash
+	/// values. The functions that take a hash find such a value with the hash
+	/// `cf::fold_hash<hash_type>(hasher_policy::hash(value))`.
+	void insert(const T &value)
+	{
+		insert(_hash_value(value), value);
+	}
+
 	/// Checks if `value` is an element of the hashset.
 	/// Returns true if an entry with `value` was found, false otherwise.
-	bool has(uint32_t hash, const T &value) const
+	bool has(hash_type hash, const T &value) const
+	{
+		return has<T>(hash, value);
+	}
+
+	/// Like `has()`, but the hash is computed with the hasher policy.
+	bool has(const T &value) const
+	{
+		return has<T>(_hash_value(value), value);
+	}
+
+	/// Like `has()`, but with a value of any type the equality policy can compare
+	/// values with, so no temporary `T` has to be built. The hash has to be the same as
+	/// the hash of the equal `T`.
+	template <typename TV>
+	_if_comparable<TV, bool> has(hash_type hash, const TV &value) const
 	{
 		hash = _hash(hash);
 		uint32_t _pos = 0;
 		return _lookup_pos(hash, value, _pos);
 	}
 
+	/// Checks `n` values at once. For every index `i`, `found[i]` is set to whether
+	/// `values[i]` with the hash `hashes[i]` is an element of the hashset.
+	/// While a value is resolved, the home slots of the values a few positions ahead
+	/// get prefetched, so the cache misses of the whole batch overlap instead of being
+	/// paid one after another.
+	void has_batch(const hash_type *hashes, const T *values, bool *found, size_t n) const
+	{
+		size_t window = TTraits::prefetch_distance < n ? TTraits::prefetch_distance : n;
+		for (size_t i = 0; i < window; i++) {
+			_prefetch_home(_hash(hashes[i]));
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			if (i + window < n) {
+				_prefetch_home(_hash(hashes[i + window]));
+			}
+
+			uint32_t pos = 0;
+			found[i] = _lookup_pos(_hash(hashes[i]), values[i], pos);
+		}
+	}
+
 	/// Remove a value from the hashset.
-	void remove(uint32_t hash, const T &value)
+	void remove(hash_type hash, const T &value)
+	{
+		remove<T>(hash, value);
+	}
+
+	/// Like `remove()`, but the hash is computed with the hasher policy.
+	void remove(const T &value)
+	{
+		remove<T>(_hash_value(value), value);
+	}
+
+	/// Like `remove()`, but with a value of any type the equality policy can compare
+	/// values with.
+	template <typename TV>
+	_if_comparable<TV, void> remove(hash_type hash, const TV &value)
 	{
 		hash = _hash(hash);
 		uint32_t pos = 0;
@@ -211,15 +719,45 @@ public:
 			return;
 		}
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		hashes[pos] |= DELETED_HASH_BIT;
-		m_num_elements--;
+		_remove_at(pos);
+	}
+
+	/// Returns the number of slots a lookup of the given hash and value has to inspect.
+	/// This is meant for tuning and benchmarking, it walks the probe chain the same way
+	/// `has()` does, so it's not any cheaper than a lookup.
+	size_t probe_length(hash_type hash, const T &value) const
+	{
+		hash = _hash(hash);
+		uint32_t pos = _home(hash);
+		uint32_t distance = 0;
+
+		slot_type *hashes = m_hashes;
+		T *values = m_values;
+
+		while (distance < m_capacity && distance <= hash_policy::max_distance) {
+			if (hash_policy::is_empty(hashes[pos])) {
+				break;
+			}
+
+			if (distance > _get_probe_distance(pos, hashes[pos])) {
+				break;
+			}
+
+			if (hashes[pos] == hash_policy::make(hash, distance) && equality_policy::equal(values[pos], value)) {
+				break;
+			}
+
+			pos = _next(pos);
+			distance++;
+		}
+
+		return distance + 1;
 	}
 
 	/// Creates an iterator for the hashset. Use `iter_next()` to advance the iteration.
 	iter iter_start() const
 	{
-		hashset<T>::iter iter = {};
+		iter iter = {};
 		iter.offset = 0;
 		return iter;
 	}
@@ -229,49 +767,290 @@ public:
 	/// If an element was found, true will be returned, otherwise false.
 	bool iter_next(iter &iter, T &value) const
 	{
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		T *values = (T *) (m_buffer + sizeof(uint32_t) * m_capacity);
+		T *values = m_values;
 
-		for (size_t i = iter.offset; i < m_capacity; i++) {
-			if (hashes[i] == EMPTY_HASH) {
-				continue;
-			}
-			if (hashes[i] & DELETED_HASH_BIT) {
-				continue;
-			}
+		size_t pos = _next_occupied(iter.offset);
 
-			value = values[i];
-			iter.offset = i + 1;
-			return true;
+		if (pos == m_capacity) {
+			iter.offset = m_capacity;
+			return false;
 		}
-		return false;
+
+		value = values[pos];
+		iter.offset = pos + 1;
+		return true;
+	}
+
+	/// Calls `fn(value)` for every element with a pointer to the value inside of the
+	/// buffer, so nothing gets copied. The set must not be modified until `for_each()`
+	/// returns. Empty and deleted slots are skipped a whole group of hashes at a time.
+	template <typename TFn>
+	void for_each(TFn fn) const
+	{
+		const T *values = m_values;
+
+		_for_each_pos([values, &fn](uint32_t pos) {
+			fn(&values[pos]);
+		});
+	}
+
+	/// Adds every element that is in this set and in `other` to `out`. The smaller of
+	/// the two sets gets walked through linearly and its elements are looked up in the
+	/// bigger one with the hashes stored in the smaller one, so nothing gets hashed
+	/// again. The home slots of upcoming lookups get prefetched while the current ones
+	/// are resolved.
+	/// `out` has to be a different set than the two inputs, elements that are in it
+	/// already stay. Returns false if some elements didn't fit into `out`.
+	/// This needs a hash policy that stores the full hashes.
+	bool intersect_into(const hashset &other, hashset &out) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		const hashset &smaller = m_num_elements <= other.m_num_elements ? *this : other;
+		const hashset &larger = &smaller == this ? other : *this;
+
+		return smaller._filter_into(larger, out, true);
+	}
+
+	/// Like `intersect_into()`, but the lookups are split up between `num_threads`
+	/// tasks that run on `executor`, like with `cf::hashmap::bulk_build()`. Inserting
+	/// the results into `out` stays serial, so this pays off when most lookups miss the
+	/// caches.
+	template <typename TExecutor>
+	bool intersect_into(const hashset &other, hashset &out, size_t num_threads, TExecutor executor) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		const hashset &smaller = m_num_elements <= other.m_num_elements ? *this : other;
+		const hashset &larger = &smaller == this ? other : *this;
+
+		return smaller._filter_into(larger, out, true, num_threads, executor);
+	}
+
+	/// Adds every element of this set and of `other` to `out`, the bigger set first.
+	/// `out` has to be a different set than the two inputs. Returns false if some
+	/// elements didn't fit into `out`.
+	/// This needs a hash policy that stores the full hashes.
+	bool union_into(const hashset &other, hashset &out) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		const hashset &smaller = m_num_elements <= other.m_num_elements ? *this : other;
+		const hashset &larger = &smaller == this ? other : *this;
+
+		bool complete = true;
+
+		larger._for_each_pos_prefetched(out, 0, larger.m_capacity, [&](uint32_t pos) {
+			complete &= larger._add_to(out, pos);
+		});
+		smaller._for_each_pos_prefetched(out, 0, smaller.m_capacity, [&](uint32_t pos) {
+			complete &= smaller._add_to(out, pos);
+		});
+
+		return complete;
+	}
+
+	/// Adds every element of this set that isn't in `other` to `out`.
+	/// `out` has to be a different set than the two inputs. Returns false if some
+	/// elements didn't fit into `out`.
+	/// This needs a hash policy that stores the full hashes.
+	bool difference_into(const hashset &other, hashset &out) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		return _filter_into(other, out, false);
+	}
+
+	/// Like `difference_into()`, but the lookups in `other` are split up between
+	/// `num_threads` tasks that run on `executor`.
+	template <typename TExecutor>
+	bool difference_into(const hashset &other, hashset &out, size_t num_threads, TExecutor executor) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		return _filter_into(other, out, false, num_threads, executor);
+	}
+
+	/// Checks if every element of `other` is an element of this set.
+	/// This needs a hash policy that stores the full hashes.
+	bool contains_all(const hashset &other) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		if (other.m_num_elements > m_num_elements) {
+			return false;
+		}
+
+		return other._all_in(*this, 0, other.m_capacity);
+	}
+
+	/// Like `contains_all()`, but the lookups are split up between `num_threads` tasks
+	/// that run on `executor`.
+	template <typename TExecutor>
+	bool contains_all(const hashset &other, size_t num_threads, TExecutor executor) const
+	{
+		static_assert(hash_policy::stores_hash, "set operations reuse the stored hashes, which needs a hash policy that stores full hashes");
+
+		if (other.m_num_elements > m_num_elements) {
+			return false;
+		}
+
+		if (num_threads > MAX_PARALLEL_TASKS) {
+			num_threads = MAX_PARALLEL_TASKS;
+		}
+
+		if (num_threads <= 1) {
+			return other._all_in(*this, 0, other.m_capacity);
+		}
+
+		bool all[MAX_PARALLEL_TASKS];
+		size_t per_task = (other.m_capacity + num_threads - 1) / num_threads;
+
+		executor(num_threads, [&](size_t task) {
+			size_t begin = task * per_task < other.m_capacity ? task * per_task : other.m_capacity;
+			size_t end = begin + per_task < other.m_capacity ? begin + per_task : other.m_capacity;
+
+			all[task] = other._all_in(*this, begin, end);
+		});
+
+		for (size_t task = 0; task < num_threads; task++) {
+			if (!all[task]) {
+				return false;
+			}
+		}
+
+		return true;
 	}
 
 	/// Calculates the load factor of the hashset. If the load factor is greater than 0.95
 	/// then `copy()` should be used to relocate the hashet for better performance.
+	/// `stats()` tells more precisely how much lookups suffer.
 	inline float load_factor() const
 	{
 		return m_num_elements / (float) m_capacity;
 	}
 
+	/// Collects statistics about the slots of the set: the probe distances of the elements,
+	/// tombstones and runs of occupied slots. This reads the whole hashes region, so it
+	/// costs about as much as iterating the set. A growing mean probe distance or a lot of
+	/// tombstones mean it's time to `copy()` the set into a fresh buffer.
+	hash_stats stats() const
+	{
+		hash_stats stats = {};
+
+		stats.capacity = m_capacity;
+		stats.num_elements = m_num_elements;
+
+		uint64_t total_distance = 0;
+		size_t run = 0;
+		size_t first_run = 0;
+		bool seen_empty = false;
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			slot_type slot = m_hashes[i];
+
+			if (hash_policy::is_empty(slot)) {
+				if (!seen_empty) {
+					first_run = run;
+					seen_empty = true;
+				}
+				run = 0;
+				continue;
+			}
+
+			run++;
+			if (run > stats.longest_run) {
+				stats.longest_run = run;
+			}
+
+			if (hash_policy::is_deleted(slot)) {
+				stats.num_tombstones++;
+				continue;
+			}
+
+			uint32_t distance = _get_probe_distance((uint32_t) i, slot);
+			total_distance += distance;
+
+			if (distance > stats.max_probe_distance) {
+				stats.max_probe_distance = distance;
+			}
+
+			stats.probe_distance_histogram[distance < hash_stats::HISTOGRAM_SIZE ? distance : hash_stats::HISTOGRAM_SIZE - 1]++;
+		}
+
+		// The run at the end of the table continues at its start.
+		if (seen_empty && run + first_run > stats.longest_run) {
+			stats.longest_run = run + first_run;
+		}
+
+		if (m_capacity > 0) {
+			stats.load_factor = m_num_elements / (float) m_capacity;
+			stats.effective_load_factor = (m_num_elements + stats.num_tombstones) / (float) m_capacity;
+		}
+
+		if (m_num_elements > 0) {
+			stats.mean_probe_distance = total_distance / (float) m_num_elements;
+		}
+
+		this->_read_probe_counters(stats);
+
+		return stats;
+	}
+
+	/// Resets the lookup counters of `stats()`.
+	void reset_probe_counters()
+	{
+		this->_reset_probe_counters();
+	}
+
 	/// Creates a new hashset using a different buffer. All values of the current map
 	/// will be inserted into the new map.
-	hashset<T> copy(size_t buffer_size, void *buffer) const
+	/// This needs a hash policy that stores the full hashes. For other policies use the
+	/// overload that takes a hash function.
+	hashset copy(size_t buffer_size, void *buffer) const
+	{
+		static_assert(hash_policy::stores_hash, "the hash policy doesn't store full hashes, provide a hash function to copy()");
+
+		hashset new_hashset = hashset::create(buffer_size, buffer);
+
+		slot_type *hashes = m_hashes;
+		T *values = m_values;
+
+		for (size_t i = 0; i < m_capacity; i++) {
+			if (hash_policy::is_empty(hashes[i])) {
+				continue;
+			}
+			if (hash_policy::is_deleted(hashes[i])) {
+				continue;
+			}
+
+			new_hashset._insert(hash_policy::hash(hashes[i]), values[i]);
+		}
+
+		return new_hashset;
+	}
+
+	/// Creates a new hashset using a different buffer like `copy()`, but the hashes of
+	/// the values get calculated again by calling `hash_fn(value)`.
+	/// This works with every hash policy, including the ones that don't store the full
+	/// hashes, like `cf::fingerprint8`.
+	template <typename THashFn>
+	hashset copy(size_t buffer_size, void *buffer, THashFn hash_fn) const
 	{
-		hashset<T> new_hashset = hashset::create(buffer_size, buffer);
+		hashset new_hashset = hashset::create(buffer_size, buffer);
 
-		uint32_t *hashes = (uint32_t *) m_buffer;
-		T *values = (T *) (m_buffer + sizeof(uint32_t) * m_capacity);
+		slot_type *hashes = m_hashes;
+		T *values = m_values;
 
 		for (size_t i = 0; i < m_capacity; i++) {
-			if (hashes[i] == EMPTY_HASH) {
+			if (hash_policy::is_empty(hashes[i])) {
 				continue;
 			}
-			if (hashes[i] & DELETED_HASH_BIT) {
+			if (hash_policy::is_deleted(hashes[i])) {
 				continue;
 			}
 
-			new_hashset.insert(hashes[i], values[i]);
+			new_hashset._insert(_hash(hash_fn(values[i])), values[i]);
 		}
 
 		return new_hashset;
@@ -291,6 +1070,40 @@ public:
 
 };
 
+/// A `cf::hashset` with `N` slots that carries its buffer inside of itself, for sets
+/// whose size is known up front. The capacity is a compile-time constant, so finding
+/// a slot compiles down to a mask (if `N` is a power of two) or a multiplication and no
+/// division is left. Everything else works like with `cf::hashset`, the set can be
+/// used right after it was constructed.
+/// The set can't be copied, because the hashset points into its own storage.
+template <typename T, size_t N, typename TTraits = hash_traits>
+struct static_hashset
+	: private inline_buffer<hashset<T, hash_traits_fixed<TTraits, N> >::buffer_size(N),
+	                        hashset<T, hash_traits_fixed<TTraits, N> >::_alignment()>,
+	  public hashset<T, hash_traits_fixed<TTraits, N> > {
+
+	typedef hashset<T, hash_traits_fixed<TTraits, N> > set_type;
+
+	static_hashset()
+		: set_type(set_type::create(sizeof(this->m_storage), this->m_storage))
+	{
+	}
+
+	static_hashset(const static_hashset &) = delete;
+	static_hashset &operator=(const static_hashset &) = delete;
+
+	/// The number of slots, known at compile time.
+	static constexpr size_t capacity()
+	{
+		return N;
+	}
+
+	/// The number of bytes the set takes up including its storage.
+	static constexpr size_t storage_size()
+	{
+		return set_type::buffer_size(N);
+	}
+};
 
 }
 
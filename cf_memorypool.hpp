@@ -35,6 +35,8 @@ namespace cf {
 /// Each element stored in the buffer is a union of the actual data and
 /// the index type. So for maximum space efficiency, the index type should
 /// be smaller than the value type.
+/// Freeing an element only overwrites its first `sizeof(IndexType)` bytes, the rest
+/// of it stays as it was.
 template <typename T, typename IndexType = uint32_t>
 struct memorypool {
 private:
@@ -43,8 +45,18 @@ private:
 
 	size_t m_capacity;
 
+	// Elements at this index and after it were never handed out, they don't need to be
+	// on the free list.
+	size_t m_num_touched;
+
+	// The first element of the free list, `FREE_LIST_END` if it's empty. The free list
+	// holds every touched element that isn't in use, so links are only ever read from
+	// elements that were freed before.
 	IndexType next_free;
 
+	// The capacity is limited to the largest index, so that index never is an element.
+	static const IndexType FREE_LIST_END = (IndexType) -1;
+
 	typedef union { T value; IndexType next; } element_t;
 
 	element_t *m_buffer;
@@ -53,6 +65,10 @@ public:
 
 	/// This function constructs a new memory pool. The `buffer` is a chunk of memory
 	/// of size `buffer_size` which the memory pool will "draw" from.
+	/// The buffer isn't touched here. Elements are handed out from the start of the
+	/// buffer in order until every element was used once, only after that freed elements
+	/// get reused. So memory that was never allocated is never written, and pages of a
+	/// big buffer only get committed once they are used.
 	static memorypool<T, IndexType> create(size_t buffer_size, void *buffer)
 	{
 		memorypool<T, IndexType> pool;
@@ -61,12 +77,13 @@ public:
 		pool.m_num_elements = 0;
 		pool.m_capacity = buffer_size / sizeof(element_t);
 
-		// now set all the next pointers to the next element
-		for (IndexType i = 0; i < pool.m_capacity; i++) {
-			pool.m_buffer[i].next = (i + 1) % pool.m_capacity;
+		// every index has to fit into the index type, the largest one ends the free list
+		if (pool.m_capacity > (size_t) (IndexType) -1) {
+			pool.m_capacity = (size_t) (IndexType) -1;
 		}
 
-		pool.next_free = 0;
+		pool.m_num_touched = 0;
+		pool.next_free = FREE_LIST_END;
 
 		return pool;
 	}
@@ -75,18 +92,49 @@ public:
 	/// If not enough space is available, `nullptr` will be returned.
 	T *allocate()
 	{
-		if (m_num_elements == m_capacity) {
-			return nullptr;
+		if (next_free != FREE_LIST_END) {
+			IndexType index = next_free;
+			next_free = m_buffer[index].next;
+			m_num_elements++;
+
+			return &m_buffer[index].value;
 		}
 
-		IndexType new_next_free = m_buffer[next_free].next;
-		IndexType old_next_free = next_free;
-		m_buffer[next_free].next = m_buffer[new_next_free].next;
+		if (m_num_touched == m_capacity) {
+			return nullptr;
+		}
 
 		m_num_elements++;
-		next_free = new_next_free;
+		return &m_buffer[m_num_touched++].value;
+	}
+
+	/// Allocates up to `n` elements at once and writes pointers to them to `out`.
+	/// Returns how many elements were allocated, which is less than `n` only if the pool
+	/// ran out of space. Elements that were never used before are handed out as one
+	/// range, without reading any free list links.
+	size_t allocate_n(T **out, size_t n)
+	{
+		size_t count = 0;
+
+		while (count < n && next_free != FREE_LIST_END) {
+			IndexType index = next_free;
+			next_free = m_buffer[index].next;
+			m_num_elements++;
+
+			out[count++] = &m_buffer[index].value;
+		}
 
-		return &m_buffer[old_next_free].value;
+		size_t untouched = m_capacity - m_num_touched;
+		size_t from_range = n - count < untouched ? n - count : untouched;
+
+		for (size_t i = 0; i < from_range; i++) {
+			out[count++] = &m_buffer[m_num_touched + i].value;
+		}
+
+		m_num_touched += from_range;
+		m_num_elements += from_range;
+
+		return count;
 	}
 
 	/// Free a previously used element.
@@ -94,11 +142,26 @@ public:
 	{
 		IndexType index = ((element_t *) element - m_buffer);
 
-		IndexType old_next_free = next_free;
+		m_buffer[index].next = next_free;
 		next_free = index;
 		m_num_elements--;
+	}
+
+	/// Frees `n` previously used elements. They get linked to each other first and then
+	/// put on the free list as a whole, so none of the links depend on each other.
+	void free_n(T **elements, size_t n)
+	{
+		if (n == 0) {
+			return;
+		}
+
+		for (size_t i = 0; i + 1 < n; i++) {
+			((element_t *) elements[i])->next = (IndexType) ((element_t *) elements[i + 1] - m_buffer);
+		}
 
-		m_buffer[index].next = old_next_free;
+		((element_t *) elements[n - 1])->next = next_free;
+		next_free = (IndexType) ((element_t *) elements[0] - m_buffer);
+		m_num_elements -= n;
 	}
 
 	/// The load factor of the memory pool (from 0.0 to 1.0).
@@ -121,6 +184,369 @@ public:
 
 };
 
+/// A memory pool like `cf::memorypool` for `N` elements that are stored inside of the
+/// pool itself. The capacity is a compile-time constant and elements are addressed
+/// relative to the pool, so there is no buffer pointer to load.
+/// The constructor is `constexpr`, so a pool with static storage duration is ready
+/// before any code runs. It has to zero the elements to be `constexpr` though, so
+/// constructing a pool on the stack writes all of it once.
+/// Copying the pool copies its elements, pointers handed out by the original still
+/// point into the original.
+template <typename T, size_t N, typename IndexType = uint32_t>
+struct static_memorypool {
+
+	static_assert(N > 0 && N <= (size_t) (IndexType) -1, "every index has to fit into the index type, the largest one ends the free list");
+
+private:
+
+	size_t m_num_elements;
+
+	// Elements at this index and after it were never handed out.
+	size_t m_num_touched;
+
+	// The first element of the free list, `FREE_LIST_END` if it's empty.
+	IndexType next_free;
+
+	static const IndexType FREE_LIST_END = (IndexType) -1;
+
+	union element_t {
+		T value;
+		IndexType next;
+
+		constexpr element_t() : next(0) {}
+	};
+
+	element_t m_elements[N];
+
+public:
+
+	constexpr static_memorypool()
+		: m_num_elements(0), m_num_touched(0), next_free(FREE_LIST_END), m_elements()
+	{
+	}
+
+	/// Allocate a new element of type `T`.
+	/// If not enough space is available, `nullptr` will be returned.
+	T *allocate()
+	{
+		if (next_free != FREE_LIST_END) {
+			IndexType index = next_free;
+			next_free = m_elements[index].next;
+			m_num_elements++;
+
+			return &m_elements[index].value;
+		}
+
+		if (m_num_touched == N) {
+			return nullptr;
+		}
+
+		m_num_elements++;
+		return &m_elements[m_num_touched++].value;
+	}
+
+	/// Free a previously used element.
+	void free(T *element)
+	{
+		IndexType index = ((element_t *) element - m_elements);
+
+		m_elements[index].next = next_free;
+		next_free = index;
+		m_num_elements--;
+	}
+
+	/// The load factor of the memory pool (from 0.0 to 1.0).
+	float load_factor() const
+	{
+		return (float)m_num_elements / N;
+	}
+
+	/// number of used elements in the memory pool
+	size_t num_elements() const
+	{
+		return m_num_elements;
+	}
+
+	/// maxium number of elements the memory pool can hold.
+	static constexpr size_t capacity()
+	{
+		return N;
+	}
+};
+
+/// A memory pool like `cf::memorypool` that can draw from more than one buffer.
+/// More buffers ("chunks") can be added with `add_chunk()` when the pool runs full, and
+/// chunks that have no elements in use anymore can be taken out again with
+/// `try_reclaim_chunk()`, so the pool doesn't have to be sized for the peak load.
+/// All chunks share one free list. An index stores the chunk in its upper `ChunkBits`
+/// bits and the offset in the chunk in the rest, so a chunk can hold at most
+/// `2^(bits of IndexType - ChunkBits)` elements and there are at most `2^ChunkBits`
+/// chunks. With the default of 4 bits and `uint16_t` indices, that's 16 chunks of
+/// up to 4096 elements.
+/// Chunks use the same element size as `cf::memorypool`, so they can be sized with
+/// `CF_MEMORYPOOL_BUFFER_SIZE_CUSTOM_IDX`.
+template <typename T, typename IndexType = uint32_t, unsigned ChunkBits = 4>
+struct chunked_memorypool {
+
+	static_assert(ChunkBits > 0 && ChunkBits < sizeof(IndexType) * 8, "the index type needs bits for the chunk and the offset");
+
+	/// The maximum number of chunks.
+	static const size_t MAX_CHUNKS = (size_t) 1 << ChunkBits;
+
+	/// The maximum number of elements in a single chunk.
+	static const size_t MAX_CHUNK_ELEMENTS = (size_t) 1 << (sizeof(IndexType) * 8 - ChunkBits);
+
+private:
+	static const unsigned OFFSET_BITS = sizeof(IndexType) * 8 - ChunkBits;
+
+	typedef union { T value; IndexType next; } element_t;
+
+	struct chunk {
+		element_t *buffer;
+		size_t capacity;
+		size_t num_touched;
+		size_t num_elements;
+	};
+
+	chunk m_chunks[MAX_CHUNKS];
+
+	size_t m_num_elements;
+
+	size_t m_capacity;
+
+	// The length of the free list. Like in `cf::memorypool`, the free list only holds
+	// elements that were handed out before.
+	size_t m_num_free;
+
+	IndexType next_free;
+
+	// The chunk that new elements are handed out from once the free list is empty.
+	size_t m_bump_chunk;
+
+	element_t &_element(IndexType index)
+	{
+		return m_chunks[index >> OFFSET_BITS].buffer[index & (MAX_CHUNK_ELEMENTS - 1)];
+	}
+
+	static IndexType _index(size_t chunk_id, size_t offset)
+	{
+		return (IndexType) ((chunk_id << OFFSET_BITS) | offset);
+	}
+
+	size_t _chunk_of(element_t *element) const
+	{
+		for (size_t c = 0; c < MAX_CHUNKS; c++) {
+			if (element >= m_chunks[c].buffer && element < m_chunks[c].buffer + m_chunks[c].capacity) {
+				return c;
+			}
+		}
+		return MAX_CHUNKS;
+	}
+
+public:
+
+	/// This function constructs a new memory pool without any chunks.
+	static chunked_memorypool create()
+	{
+		chunked_memorypool pool;
+
+		for (size_t c = 0; c < MAX_CHUNKS; c++) {
+			pool.m_chunks[c].buffer = nullptr;
+			pool.m_chunks[c].capacity = 0;
+			pool.m_chunks[c].num_touched = 0;
+			pool.m_chunks[c].num_elements = 0;
+		}
+
+		pool.m_num_elements = 0;
+		pool.m_capacity = 0;
+		pool.m_num_free = 0;
+		pool.next_free = 0;
+		pool.m_bump_chunk = 0;
+
+		return pool;
+	}
+
+	/// This function constructs a new memory pool with `buffer` as the first chunk.
+	static chunked_memorypool create(size_t buffer_size, void *buffer)
+	{
+		chunked_memorypool pool = create();
+		pool.add_chunk(buffer_size, buffer);
+		return pool;
+	}
+
+	/// Adds a buffer of `buffer_size` bytes to draw elements from. Like with
+	/// `cf::memorypool`, the buffer isn't touched until its elements are used.
+	/// Returns false if there are `MAX_CHUNKS` chunks already or the buffer can't hold
+	/// a single element.
+	bool add_chunk(size_t buffer_size, void *buffer)
+	{
+		size_t capacity = buffer_size / sizeof(element_t);
+		if (capacity == 0) {
+			return false;
+		}
+
+		if (capacity > MAX_CHUNK_ELEMENTS) {
+			capacity = MAX_CHUNK_ELEMENTS;
+		}
+
+		for (size_t c = 0; c < MAX_CHUNKS; c++) {
+			if (m_chunks[c].buffer != nullptr) {
+				continue;
+			}
+
+			m_chunks[c].buffer = (element_t *) buffer;
+			m_chunks[c].capacity = capacity;
+			m_chunks[c].num_touched = 0;
+			m_chunks[c].num_elements = 0;
+
+			m_capacity += capacity;
+
+			if (m_chunks[m_bump_chunk].num_touched == m_chunks[m_bump_chunk].capacity) {
+				m_bump_chunk = c;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	/// Takes a chunk that has no elements in use out of the pool and returns its buffer,
+	/// which then belongs to the caller again. Returns `nullptr` if every chunk has
+	/// elements in use.
+	/// The freed elements of the chunk have to be removed from the free list, so this
+	/// walks the whole free list once.
+	void *try_reclaim_chunk()
+	{
+		size_t c = MAX_CHUNKS;
+
+		// prefer chunks that were added late, the first one usually stays
+		while (c-- > 0) {
+			if (m_chunks[c].buffer != nullptr && m_chunks[c].num_elements == 0) {
+				break;
+			}
+		}
+
+		if (c == (size_t) -1) {
+			return nullptr;
+		}
+
+		chunk &reclaimed = m_chunks[c];
+
+		size_t num_removed = reclaimed.num_touched;
+
+		if (num_removed > 0) {
+			// rebuild the free list without the elements of the chunk, keeping the order
+			IndexType index = next_free;
+			IndexType *link = &next_free;
+			size_t kept = 0;
+
+			for (size_t i = 0; i < m_num_free; i++) {
+				IndexType next = _element(index).next;
+
+				if ((size_t) (index >> OFFSET_BITS) != c) {
+					*link = index;
+					link = &_element(index).next;
+					kept++;
+				}
+
+				index = next;
+			}
+
+			m_num_free = kept;
+		}
+
+		void *buffer = reclaimed.buffer;
+
+		m_capacity -= reclaimed.capacity;
+
+		reclaimed.buffer = nullptr;
+		reclaimed.capacity = 0;
+		reclaimed.num_touched = 0;
+
+		return buffer;
+	}
+
+	/// Allocate a new element of type `T`.
+	/// If no chunk has space left, `nullptr` will be returned.
+	T *allocate()
+	{
+		if (m_num_free > 0) {
+			IndexType index = next_free;
+			element_t &element = _element(index);
+
+			next_free = element.next;
+			m_num_free--;
+			m_num_elements++;
+			m_chunks[index >> OFFSET_BITS].num_elements++;
+
+			return &element.value;
+		}
+
+		if (m_chunks[m_bump_chunk].num_touched == m_chunks[m_bump_chunk].capacity) {
+			size_t c = 0;
+			while (c < MAX_CHUNKS && m_chunks[c].num_touched == m_chunks[c].capacity) {
+				c++;
+			}
+
+			if (c == MAX_CHUNKS) {
+				return nullptr;
+			}
+
+			m_bump_chunk = c;
+		}
+
+		chunk &current = m_chunks[m_bump_chunk];
+
+		current.num_elements++;
+		m_num_elements++;
+
+		return &current.buffer[current.num_touched++].value;
+	}
+
+	/// Free a previously used element. The chunk it belongs to is found from its address.
+	void free(T *element)
+	{
+		size_t c = _chunk_of((element_t *) element);
+		size_t offset = (element_t *) element - m_chunks[c].buffer;
+
+		((element_t *) element)->next = next_free;
+		next_free = _index(c, offset);
+
+		m_num_free++;
+		m_num_elements--;
+		m_chunks[c].num_elements--;
+	}
+
+	/// The load factor of the memory pool over all chunks (from 0.0 to 1.0).
+	float load_factor() const
+	{
+		return (float)m_num_elements / m_capacity;
+	}
+
+	/// number of used elements in the memory pool
+	size_t num_elements() const
+	{
+		return m_num_elements;
+	}
+
+	/// maxium number of elements all chunks together can hold.
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+
+	/// The number of chunks in the pool.
+	size_t num_chunks() const
+	{
+		size_t n = 0;
+		for (size_t c = 0; c < MAX_CHUNKS; c++) {
+			n += m_chunks[c].buffer != nullptr;
+		}
+		return n;
+	}
+};
+
 }
 
 
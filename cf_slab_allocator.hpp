@@ -0,0 +1,254 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+///
+/// This is a single-header library that provides a slab allocator for allocations
+/// of different sizes in a user-given buffer. The buffer is split into one pool per
+/// power-of-two size class, every pool works like `cf::memorypool`.
+///
+#ifndef CF_SLAB_ALLOCATOR_HPP
+#define CF_SLAB_ALLOCATOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CF_CACHE_LINE_SIZE
+#define CF_CACHE_LINE_SIZE 64
+#endif
+
+namespace cf {
+
+/// An allocator for blocks between `MinSize` and `MaxSize` bytes in a user-given buffer.
+/// Both sizes have to be powers of two. There is a size class for every power of two
+/// in between, an allocation gets a block of the smallest class it fits into.
+/// Every class is a pool of fixed size blocks in its own part of the buffer. Like with
+/// `cf::memorypool`, blocks are handed out from the start of that part in order until
+/// every block was used once, freed blocks store the index of the next free block.
+/// Allocations never fall back to a bigger class, so a class that is used up returns
+/// `nullptr` even if other classes still have room.
+template <size_t MinSize = 64, size_t MaxSize = 4096>
+struct slab_allocator {
+
+	static_assert(MinSize >= sizeof(uint32_t), "free blocks store a 32 bit index, so blocks need at least 4 bytes");
+	static_assert((MinSize & (MinSize - 1)) == 0 && (MaxSize & (MaxSize - 1)) == 0, "block sizes have to be powers of two");
+	static_assert(MinSize <= MaxSize, "MinSize can't be bigger than MaxSize");
+
+private:
+	static constexpr size_t _log2(size_t n)
+	{
+		return n <= 1 ? 0 : 1 + _log2(n / 2);
+	}
+
+public:
+
+	/// The number of size classes.
+	static const size_t NUM_CLASSES = _log2(MaxSize / MinSize) + 1;
+
+private:
+	static constexpr size_t _align_up(size_t offset, size_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// Region starts get aligned to the block size, up to a cache line.
+	static constexpr size_t _region_alignment(size_t size_class)
+	{
+		return (MinSize << size_class) < CF_CACHE_LINE_SIZE ? (MinSize << size_class) : CF_CACHE_LINE_SIZE;
+	}
+
+	struct pool {
+		uint8_t *blocks;
+		size_t capacity;
+		size_t num_elements;
+		size_t num_touched;
+
+		// The first block of the free list, `FREE_LIST_END` if it's empty.
+		uint32_t next_free;
+	};
+
+	// The capacity of a class is limited to the largest index, so that index never is a block.
+	static const uint32_t FREE_LIST_END = 0xFFFFFFFF;
+
+	pool m_pools[NUM_CLASSES];
+
+	static constexpr size_t _block_size(size_t size_class)
+	{
+		return MinSize << size_class;
+	}
+
+	uint32_t &_next(size_t size_class, uint32_t index)
+	{
+		return *(uint32_t *) (m_pools[size_class].blocks + _block_size(size_class) * index);
+	}
+
+public:
+
+	/// The size class of an allocation of `size` bytes, `NUM_CLASSES` if it's bigger than
+	/// `MaxSize`. This is the smallest `c` with `MinSize << c >= size`, which comes from
+	/// the highest set bit of `size - 1` with a single count-leading-zeros instruction.
+	static size_t size_class(size_t size)
+	{
+		if (size > MaxSize) {
+			return NUM_CLASSES;
+		}
+
+		if (size <= MinSize) {
+			return 0;
+		}
+
+		size_t bits = 64 - (size_t) __builtin_clzll((unsigned long long) (size - 1));
+		return bits - _log2(MinSize);
+	}
+
+	/// The size of the blocks of a size class.
+	static constexpr size_t class_size(size_t size_class)
+	{
+		return _block_size(size_class);
+	}
+
+	/// The size of a buffer that holds `num_blocks[i]` blocks of every size class `i`,
+	/// including the padding between the classes.
+	static size_t buffer_size(const size_t *num_blocks)
+	{
+		size_t size = 0;
+
+		for (size_t c = 0; c < NUM_CLASSES; c++) {
+			size = _align_up(size, _region_alignment(c)) + _block_size(c) * num_blocks[c];
+		}
+
+		return size;
+	}
+
+	/// This function constructs a new slab allocator. The buffer of `buffer_size`
+	/// bytes gets split into one region per size class that holds `num_blocks[i]` blocks
+	/// of class `i`. If the buffer is too small, the classes at the end get fewer blocks.
+	/// The buffer should start on a cache line, then every block that is at least as big
+	/// as a cache line starts on one too.
+	static slab_allocator create(size_t buffer_size, void *buffer, const size_t *num_blocks)
+	{
+		slab_allocator slab;
+
+		uint8_t *start = (uint8_t *) buffer;
+		size_t offset = 0;
+
+		for (size_t c = 0; c < NUM_CLASSES; c++) {
+			offset = _align_up(offset, _region_alignment(c));
+
+			size_t available = offset < buffer_size ? (buffer_size - offset) / _block_size(c) : 0;
+			size_t capacity = num_blocks[c] < available ? num_blocks[c] : available;
+
+			if (capacity > 0xFFFFFFFF) {
+				capacity = 0xFFFFFFFF;
+			}
+
+			pool &p = slab.m_pools[c];
+			p.blocks = start + offset;
+			p.capacity = capacity;
+			p.num_elements = 0;
+			p.num_touched = 0;
+			p.next_free = FREE_LIST_END;
+
+			offset += _block_size(c) * capacity;
+		}
+
+		return slab;
+	}
+
+	/// Like the other `create()`, but every size class gets about the same number of
+	/// bytes, so small classes get more blocks than big ones.
+	static slab_allocator create(size_t buffer_size, void *buffer)
+	{
+		size_t num_blocks[NUM_CLASSES];
+
+		// leave room for the padding between the regions
+		size_t padding = NUM_CLASSES * CF_CACHE_LINE_SIZE;
+		size_t per_class = buffer_size > padding ? (buffer_size - padding) / NUM_CLASSES : 0;
+
+		for (size_t c = 0; c < NUM_CLASSES; c++) {
+			num_blocks[c] = per_class / _block_size(c);
+		}
+
+		return create(buffer_size, buffer, num_blocks);
+	}
+
+	/// Allocate a block of at least `size` bytes.
+	/// Returns `nullptr` if the size is bigger than `MaxSize` or its size class is used up.
+	void *allocate(size_t size)
+	{
+		size_t c = size_class(size);
+		if (c == NUM_CLASSES) {
+			return nullptr;
+		}
+
+		pool &p = m_pools[c];
+
+		if (p.next_free != FREE_LIST_END) {
+			uint32_t index = p.next_free;
+			p.next_free = _next(c, index);
+			p.num_elements++;
+
+			return p.blocks + _block_size(c) * index;
+		}
+
+		if (p.num_touched == p.capacity) {
+			return nullptr;
+		}
+
+		p.num_elements++;
+		return p.blocks + _block_size(c) * p.num_touched++;
+	}
+
+	/// Free a previously allocated block. The size class is found from the address.
+	void free(void *block)
+	{
+		uint8_t *address = (uint8_t *) block;
+
+		for (size_t c = 0; c < NUM_CLASSES; c++) {
+			pool &p = m_pools[c];
+
+			if (address < p.blocks || address >= p.blocks + _block_size(c) * p.capacity) {
+				continue;
+			}
+
+			uint32_t index = (uint32_t) ((size_t) (address - p.blocks) / _block_size(c));
+
+			_next(c, index) = p.next_free;
+			p.next_free = index;
+			p.num_elements--;
+			return;
+		}
+	}
+
+	/// The load factor of a size class (from 0.0 to 1.0).
+	float load_factor(size_t size_class) const
+	{
+		return (float) m_pools[size_class].num_elements / m_pools[size_class].capacity;
+	}
+
+	/// The number of blocks of a size class that are in use.
+	size_t num_elements(size_t size_class) const
+	{
+		return m_pools[size_class].num_elements;
+	}
+
+	/// The number of blocks of a size class.
+	size_t capacity(size_t size_class) const
+	{
+		return m_pools[size_class].capacity;
+	}
+
+	/// The number of blocks in use over all size classes.
+	size_t num_elements() const
+	{
+		size_t n = 0;
+		for (size_t c = 0; c < NUM_CLASSES; c++) {
+			n += m_pools[c].num_elements;
+		}
+		return n;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,271 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+///
+/// This is a single-header library that provides a slot map: a container that hands
+/// out handles to its elements which can be checked for validity, stored in a
+/// user-given buffer.
+///
+#ifndef CF_SLOT_MAP_HPP
+#define CF_SLOT_MAP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+#include "cf_memorypool.hpp"
+
+/// This macro calculates the size of a buffer that can hold n elements of type `type`.
+#define CF_SLOT_MAP_BUFFER_SIZE(type, n) (cf::slot_map<type>::buffer_size(n))
+
+namespace cf {
+
+/// A container that hands out handles instead of pointers. A handle packs the index of
+/// a slot in its lower `IndexBits` bits and the generation of that slot in the bits
+/// above. The generation of a slot changes every time its element gets removed, so a
+/// handle to a removed element is detected in O(1), even if the slot has been reused
+/// since.
+/// The slots are allocated from a `cf::memorypool` and point into a dense array of the
+/// elements, which stays packed when elements get removed (the last element moves into
+/// the gap). Iterating over `data()` only touches elements in use.
+/// The buffer is split into three parts: the slots, the elements and the slot of every
+/// element.
+template <typename T, typename THandle = uint64_t, unsigned IndexBits = sizeof(THandle) * 4>
+struct slot_map {
+
+	static_assert(IndexBits > 0 && IndexBits <= 32, "slot indices are 32 bit at most");
+	static_assert(IndexBits < sizeof(THandle) * 8, "the handle type needs bits for the generation");
+	static_assert(sizeof(THandle) * 8 - IndexBits <= 32, "generations are 32 bit at most");
+
+	typedef THandle handle;
+
+	/// A handle that never refers to an element.
+	static const THandle null_handle = (THandle) -1;
+
+private:
+	static const THandle INDEX_MASK = ((THandle) 1 << IndexBits) - 1;
+
+	static const uint32_t GENERATION_MASK = (uint32_t) (((THandle) -1) >> IndexBits);
+
+	// `cf::memorypool` keeps the index of the next free slot in the first bytes of a free
+	// slot, so the generation survives while the slot is free.
+	struct slot {
+		uint32_t dense_index;
+		uint32_t generation;
+	};
+
+	memorypool<slot> m_slots;
+
+	slot *m_slot_buffer;
+
+	T *m_values;
+
+	// The slot index of every element in `m_values`.
+	uint32_t *m_dense_slots;
+
+	size_t m_num_elements;
+
+	size_t m_capacity;
+
+	// Slots at this index and after it were never handed out, so their memory was never
+	// written. `cf::memorypool` hands out untouched slots in order.
+	size_t m_num_touched;
+
+	static constexpr size_t _align_up(size_t offset, size_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	static constexpr size_t _values_offset(size_t n)
+	{
+		return _align_up(CF_MEMORYPOOL_BUFFER_SIZE(slot, n), alignof(T));
+	}
+
+	static constexpr size_t _dense_slots_offset(size_t n)
+	{
+		return _align_up(_values_offset(n) + sizeof(T) * n, alignof(uint32_t));
+	}
+
+	static THandle _make_handle(uint32_t index, uint32_t generation)
+	{
+		return ((THandle) (generation & GENERATION_MASK) << IndexBits) | index;
+	}
+
+	// The slot of a handle, or `nullptr` if it refers to an element that was removed
+	// (or never existed).
+	const slot *_find(THandle h) const
+	{
+		uint32_t index = (uint32_t) (h & INDEX_MASK);
+		if (index >= m_num_touched) {
+			return nullptr;
+		}
+
+		const slot *s = &m_slot_buffer[index];
+
+		// Slots that were never used or are free don't get pointed at by an element.
+		if ((s->generation & GENERATION_MASK) != (uint32_t) (h >> IndexBits) ||
+		    s->dense_index >= m_num_elements ||
+		    m_dense_slots[s->dense_index] != index) {
+			return nullptr;
+		}
+
+		return s;
+	}
+
+public:
+
+	/// The size of a buffer that can hold `n` elements.
+	static constexpr size_t buffer_size(size_t n)
+	{
+		return _dense_slots_offset(n) + sizeof(uint32_t) * n;
+	}
+
+	/// This function constructs a new slot map. The buffer is not touched here, slots
+	/// are handed out lazily like the elements of `cf::memorypool`.
+	static slot_map create(size_t buffer_size, void *buffer)
+	{
+		slot_map map;
+
+		size_t capacity = buffer_size / (sizeof(slot) + sizeof(T) + sizeof(uint32_t));
+		while (capacity > 0 && slot_map::buffer_size(capacity) > buffer_size) {
+			capacity--;
+		}
+
+		// the highest index is left out so `null_handle` is never valid
+		if (capacity > INDEX_MASK) {
+			capacity = INDEX_MASK;
+		}
+
+		uint8_t *start = (uint8_t *) buffer;
+
+		map.m_slots = memorypool<slot>::create(CF_MEMORYPOOL_BUFFER_SIZE(slot, capacity), start);
+		map.m_slot_buffer = (slot *) start;
+		map.m_values = (T *) (start + _values_offset(capacity));
+		map.m_dense_slots = (uint32_t *) (start + _dense_slots_offset(capacity));
+		map.m_num_elements = 0;
+		map.m_capacity = capacity;
+		map.m_num_touched = 0;
+
+		return map;
+	}
+
+	/// Inserts a new element and returns a handle to it.
+	/// If not enough space is available, `null_handle` will be returned.
+	template <typename TV>
+	THandle insert(TV &&value)
+	{
+		slot *s = m_slots.allocate();
+		if (s == nullptr) {
+			return null_handle;
+		}
+
+		uint32_t index = (uint32_t) (s - m_slot_buffer);
+
+		if (index == m_num_touched) {
+			s->generation = 0;
+			m_num_touched++;
+		}
+
+		s->dense_index = (uint32_t) m_num_elements;
+
+		new (&m_values[m_num_elements]) T(static_cast<TV &&>(value));
+		m_dense_slots[m_num_elements] = index;
+		m_num_elements++;
+
+		return _make_handle(index, s->generation);
+	}
+
+	/// Returns a pointer to the element of a handle, or `nullptr` if it was removed.
+	/// The pointer is only valid until the next removal.
+	T *get(THandle h)
+	{
+		const slot *s = _find(h);
+		return s ? &m_values[s->dense_index] : nullptr;
+	}
+
+	/// Returns a pointer to the element of a handle, or `nullptr` if it was removed.
+	const T *get(THandle h) const
+	{
+		const slot *s = _find(h);
+		return s ? &m_values[s->dense_index] : nullptr;
+	}
+
+	/// Checks if a handle refers to an element.
+	bool contains(THandle h) const
+	{
+		return _find(h) != nullptr;
+	}
+
+	/// Removes the element of a handle. The last element moves into its place.
+	/// Returns false if the handle was not valid.
+	bool remove(THandle h)
+	{
+		slot *s = (slot *) _find(h);
+		if (s == nullptr) {
+			return false;
+		}
+
+		uint32_t dense_index = s->dense_index;
+		size_t last = m_num_elements - 1;
+
+		if (dense_index != last) {
+			m_values[dense_index].~T();
+			new (&m_values[dense_index]) T(static_cast<T &&>(m_values[last]));
+
+			uint32_t moved = m_dense_slots[last];
+			m_dense_slots[dense_index] = moved;
+			m_slot_buffer[moved].dense_index = dense_index;
+		}
+
+		m_values[last].~T();
+		m_num_elements--;
+
+		s->generation++;
+		m_slots.free(s);
+
+		return true;
+	}
+
+	/// The elements in use, packed at the start of the array.
+	/// Removing elements changes the order.
+	T *data()
+	{
+		return m_values;
+	}
+
+	/// The elements in use, packed at the start of the array.
+	const T *data() const
+	{
+		return m_values;
+	}
+
+	/// The handle of the element at index `i` in `data()`.
+	THandle handle_at(size_t i) const
+	{
+		uint32_t index = m_dense_slots[i];
+		return _make_handle(index, m_slot_buffer[index].generation);
+	}
+
+	/// The load factor of the slot map (from 0.0 to 1.0).
+	float load_factor() const
+	{
+		return (float)m_num_elements / m_capacity;
+	}
+
+	/// number of elements in the slot map
+	size_t num_elements() const
+	{
+		return m_num_elements;
+	}
+
+	/// maxium number of elements the slot map can hold.
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+};
+
+}
+
+#endif
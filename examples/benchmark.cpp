@@ -0,0 +1,865 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Benchmark suite: cf::hashmap, cf::hashset and cf::memorypool against
+// std::unordered_map, std::unordered_set, a dense linear probing table (keys and values
+// inline in one array, like google::dense_hash_map) and new/delete.
+//
+// Every run uses the same keys in the same order, generated from fixed seeds, and every
+// configuration is repeated a few times with the fastest repetition being reported.
+// All tables hash with the same function, so only the tables themselves differ.
+//
+// usage: benchmark [--csv] [--elements N] [--repeat N] [--filter TEXT]
+//
+//   --csv       print one comma separated line per result instead of a table:
+//               container,workload,key_size,value_size,load_factor,elements,ns_per_op,cache_misses_per_op
+//   --elements  number of elements per table (default 1048576)
+//   --repeat    repetitions per configuration (default 3)
+//   --filter    only run containers whose name contains TEXT
+//
+// Cache misses are read from the Linux perf events interface. Where that isn't
+// available (other systems, containers, a high perf_event_paranoid) they are reported
+// as "-" or left empty in the CSV output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "cf_hashmap.hpp"
+#include "cf_hashset.hpp"
+#include "cf_memorypool.hpp"
+
+// keeps the lookups from being optimized away
+static volatile uint64_t sink;
+
+static bool csv_output = false;
+static const char *container_filter = nullptr;
+
+template <size_t Size>
+struct blob {
+	uint8_t bytes[Size];
+};
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+static uint32_t hash_of(uint32_t key)
+{
+	return hash_key(key);
+}
+
+static uint32_t hash_of(uint64_t key)
+{
+	return hash_key((uint32_t) key ^ (uint32_t) (key >> 32));
+}
+
+template <typename TKey>
+struct std_hasher {
+	size_t operator()(const TKey &key) const
+	{
+		return hash_of(key);
+	}
+};
+
+template <typename TValue>
+static TValue make_value(uint32_t i)
+{
+	TValue value = {};
+	memcpy(&value, &i, sizeof(i) < sizeof(value) ? sizeof(i) : sizeof(value));
+	return value;
+}
+
+template <typename TValue>
+static uint32_t read_value(const TValue &value)
+{
+	uint32_t i = 0;
+	memcpy(&i, &value, sizeof(i) < sizeof(value) ? sizeof(i) : sizeof(value));
+	return i;
+}
+
+// Distinct keys: the multiplication is a bijection, so different `i` give different keys.
+template <typename TKey>
+static TKey make_key(uint32_t i)
+{
+	uint32_t k = i * 0x9e3779b1u + 0x7f4a7c15u;
+	return sizeof(TKey) > 4 ? (TKey) ((uint64_t) k * 0x9e3779b97f4a7c15ull) : (TKey) k;
+}
+
+static uint64_t xorshift(uint64_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+// A fixed permutation of `0..n-1`.
+static std::vector<uint32_t> make_order(size_t n, uint64_t seed)
+{
+	std::vector<uint32_t> order(n);
+	for (size_t i = 0; i < n; i++) {
+		order[i] = (uint32_t) i;
+	}
+
+	for (size_t i = n; i > 1; i--) {
+		size_t j = (size_t) (xorshift(seed) % i);
+		uint32_t tmp = order[i - 1];
+		order[i - 1] = order[j];
+		order[j] = tmp;
+	}
+
+	return order;
+}
+
+struct aligned_buffer {
+	uint8_t *allocation;
+	uint8_t *data;
+	size_t size;
+
+	explicit aligned_buffer(size_t size)
+		: allocation(new uint8_t[size + 64]),
+		  data((uint8_t *) (((uintptr_t) allocation + 63) & ~(uintptr_t) 63)),
+		  size(size)
+	{
+	}
+
+	~aligned_buffer()
+	{
+		delete[] allocation;
+	}
+
+	aligned_buffer(const aligned_buffer &) = delete;
+	aligned_buffer &operator=(const aligned_buffer &) = delete;
+};
+
+struct cache_miss_counter {
+	int fd;
+
+	cache_miss_counter()
+		: fd(-1)
+	{
+#if defined(__linux__)
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~cache_miss_counter()
+	{
+#if defined(__linux__)
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+	}
+
+	bool available() const
+	{
+		return fd >= 0;
+	}
+
+	void start()
+	{
+#if defined(__linux__)
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	uint64_t stop()
+	{
+		uint64_t count = 0;
+#if defined(__linux__)
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+				count = 0;
+			}
+		}
+#endif
+		return count;
+	}
+};
+
+static cache_miss_counter cache_misses;
+
+struct measurement {
+	double ns_per_op;
+	double misses_per_op;
+};
+
+template <typename TFn>
+static measurement measure(size_t num_ops, TFn fn)
+{
+	cache_misses.start();
+	auto start = std::chrono::steady_clock::now();
+
+	fn();
+
+	auto end = std::chrono::steady_clock::now();
+	uint64_t misses = cache_misses.stop();
+
+	measurement m;
+	m.ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / num_ops;
+	m.misses_per_op = cache_misses.available() ? misses / (double) num_ops : -1.0;
+	return m;
+}
+
+static void print_header()
+{
+	if (csv_output) {
+		printf("container,workload,key_size,value_size,load_factor,elements,ns_per_op,cache_misses_per_op\n");
+		return;
+	}
+
+	printf("%-28s %-10s %5s %6s %6s %10s %10s %12s\n",
+	       "container", "workload", "key", "value", "load", "elements", "ns/op", "misses/op");
+}
+
+static void print_result(const char *container, const char *workload, size_t key_size, size_t value_size, double load, size_t n, measurement m)
+{
+	if (csv_output) {
+		printf("%s,%s,%zu,%zu,", container, workload, key_size, value_size);
+		if (load > 0.0) {
+			printf("%.2f", load);
+		}
+		printf(",%zu,%.3f,", n, m.ns_per_op);
+		if (m.misses_per_op >= 0.0) {
+			printf("%.4f", m.misses_per_op);
+		}
+		printf("\n");
+		return;
+	}
+
+	char load_text[16] = "-";
+	char misses_text[16] = "-";
+
+	if (load > 0.0) {
+		snprintf(load_text, sizeof(load_text), "%.2f", load);
+	}
+	if (m.misses_per_op >= 0.0) {
+		snprintf(misses_text, sizeof(misses_text), "%.3f", m.misses_per_op);
+	}
+
+	printf("%-28s %-10s %5zu %6zu %6s %10zu %10.2f %12s\n",
+	       container, workload, key_size, value_size, load_text, n, m.ns_per_op, misses_text);
+}
+
+static bool selected(const char *container)
+{
+	return container_filter == nullptr || strstr(container, container_filter) != nullptr;
+}
+
+// The number of slots that puts `n` elements at the given load factor.
+static size_t slots_for_load(size_t n, double load)
+{
+	return (size_t) (n / load) + 1;
+}
+
+// The tables below all provide the same operations, so one function can run the
+// workloads on all of them. Values are built from an index with `make_value()`, only
+// their first bytes are read back.
+
+template <typename TKey, typename TValue, typename TTraits>
+struct cf_hashmap_table {
+	typedef cf::hashmap<TKey, TValue, TTraits> map_type;
+
+	aligned_buffer buffer;
+	aligned_buffer copy_buffer;
+	map_type map;
+
+	cf_hashmap_table(size_t n, double load)
+		: buffer(map_type::buffer_size(slots_for_load(n, load))),
+		  copy_buffer(map_type::buffer_size(slots_for_load(n, load)))
+	{
+		map = map_type::create(buffer.size, buffer.data);
+	}
+
+	void insert(const TKey &key, uint32_t i)
+	{
+		map.set(hash_of(key), key, make_value<TValue>(i));
+	}
+
+	bool lookup(const TKey &key, uint64_t &sum) const
+	{
+		const TValue *value = map.find(hash_of(key), key);
+		if (value == nullptr) {
+			return false;
+		}
+		sum += read_value(*value);
+		return true;
+	}
+
+	void remove(const TKey &key)
+	{
+		map.remove(hash_of(key), key);
+	}
+
+	void iterate(uint64_t &sum) const
+	{
+		map.for_each([&sum](const TKey *, const TValue *value) {
+			sum += read_value(*value);
+		});
+	}
+
+	size_t copy()
+	{
+		return map.copy(copy_buffer.size, copy_buffer.data).num_elements();
+	}
+};
+
+template <typename TKey, typename TValue>
+struct std_unordered_map_table {
+	typedef std::unordered_map<TKey, TValue, std_hasher<TKey> > map_type;
+
+	map_type map;
+	map_type copied;
+
+	std_unordered_map_table(size_t n, double load)
+	{
+		map.max_load_factor((float) load);
+		map.reserve(n);
+	}
+
+	void insert(const TKey &key, uint32_t i)
+	{
+		map[key] = make_value<TValue>(i);
+	}
+
+	bool lookup(const TKey &key, uint64_t &sum) const
+	{
+		typename map_type::const_iterator it = map.find(key);
+		if (it == map.end()) {
+			return false;
+		}
+		sum += read_value(it->second);
+		return true;
+	}
+
+	void remove(const TKey &key)
+	{
+		map.erase(key);
+	}
+
+	void iterate(uint64_t &sum) const
+	{
+		for (typename map_type::const_iterator it = map.begin(); it != map.end(); ++it) {
+			sum += read_value(it->second);
+		}
+	}
+
+	size_t copy()
+	{
+		copied = map;
+		return copied.size();
+	}
+};
+
+// Linear probing over one array of keys and values. Empty slots hold a reserved key,
+// removals shift the following entries back, so there are no tombstones. The slot of a
+// hash is found with a multiplication instead of a division.
+template <typename TKey, typename TValue>
+struct dense_table {
+	static constexpr TKey EMPTY_KEY = (TKey) -1;
+
+	struct slot {
+		TKey key;
+		TValue value;
+	};
+
+	aligned_buffer buffer;
+	aligned_buffer copy_buffer;
+	slot *slots;
+	size_t capacity;
+	size_t num_elements;
+
+	dense_table(size_t n, double load)
+		: buffer(sizeof(slot) * slots_for_load(n, load)),
+		  copy_buffer(sizeof(slot) * slots_for_load(n, load)),
+		  slots((slot *) buffer.data),
+		  capacity(slots_for_load(n, load)),
+		  num_elements(0)
+	{
+		for (size_t i = 0; i < capacity; i++) {
+			slots[i].key = EMPTY_KEY;
+		}
+	}
+
+	size_t home(const TKey &key) const
+	{
+		return (size_t) (((uint64_t) hash_of(key) * capacity) >> 32);
+	}
+
+	size_t next(size_t pos) const
+	{
+		return pos + 1 == capacity ? 0 : pos + 1;
+	}
+
+	void insert(const TKey &key, uint32_t i)
+	{
+		size_t pos = home(key);
+		while (slots[pos].key != EMPTY_KEY && slots[pos].key != key) {
+			pos = next(pos);
+		}
+
+		if (slots[pos].key == EMPTY_KEY) {
+			if (num_elements + 1 == capacity) {
+				return;
+			}
+			num_elements++;
+		}
+
+		slots[pos].key = key;
+		slots[pos].value = make_value<TValue>(i);
+	}
+
+	bool lookup(const TKey &key, uint64_t &sum) const
+	{
+		size_t pos = home(key);
+		while (slots[pos].key != EMPTY_KEY) {
+			if (slots[pos].key == key) {
+				sum += read_value(slots[pos].value);
+				return true;
+			}
+			pos = next(pos);
+		}
+		return false;
+	}
+
+	void remove(const TKey &key)
+	{
+		size_t pos = home(key);
+		while (slots[pos].key != key) {
+			if (slots[pos].key == EMPTY_KEY) {
+				return;
+			}
+			pos = next(pos);
+		}
+
+		// Move every following entry of the cluster that may live in the gap into it.
+		size_t gap = pos;
+		for (size_t i = next(pos); slots[i].key != EMPTY_KEY; i = next(i)) {
+			size_t h = home(slots[i].key);
+			bool stays = gap <= i ? (gap < h && h <= i) : (gap < h || h <= i);
+			if (!stays) {
+				slots[gap] = slots[i];
+				gap = i;
+			}
+		}
+
+		slots[gap].key = EMPTY_KEY;
+		num_elements--;
+	}
+
+	void iterate(uint64_t &sum) const
+	{
+		for (size_t i = 0; i < capacity; i++) {
+			if (slots[i].key != EMPTY_KEY) {
+				sum += read_value(slots[i].value);
+			}
+		}
+	}
+
+	size_t copy()
+	{
+		memcpy(copy_buffer.data, buffer.data, sizeof(slot) * capacity);
+		return num_elements;
+	}
+};
+
+template <typename T, typename TTraits>
+struct cf_hashset_table {
+	typedef cf::hashset<T, TTraits> set_type;
+
+	aligned_buffer buffer;
+	aligned_buffer copy_buffer;
+	set_type set;
+
+	cf_hashset_table(size_t n, double load)
+		: buffer(CF_HASHSET_GET_BUFFER_SIZE_TRAITS(TTraits, T, slots_for_load(n, load))),
+		  copy_buffer(CF_HASHSET_GET_BUFFER_SIZE_TRAITS(TTraits, T, slots_for_load(n, load)))
+	{
+		set = set_type::create(buffer.size, buffer.data);
+	}
+
+	void insert(const T &key, uint32_t)
+	{
+		set.insert(hash_of(key), key);
+	}
+
+	bool lookup(const T &key, uint64_t &sum) const
+	{
+		bool found = set.has(hash_of(key), key);
+		sum += found;
+		return found;
+	}
+
+	void remove(const T &key)
+	{
+		set.remove(hash_of(key), key);
+	}
+
+	void iterate(uint64_t &sum) const
+	{
+		set.for_each([&sum](const T *value) {
+			sum += (uint64_t) *value;
+		});
+	}
+
+	size_t copy()
+	{
+		return set.copy(copy_buffer.size, copy_buffer.data).num_elements();
+	}
+};
+
+template <typename T>
+struct std_unordered_set_table {
+	typedef std::unordered_set<T, std_hasher<T> > set_type;
+
+	set_type set;
+	set_type copied;
+
+	std_unordered_set_table(size_t n, double load)
+	{
+		set.max_load_factor((float) load);
+		set.reserve(n);
+	}
+
+	void insert(const T &key, uint32_t)
+	{
+		set.insert(key);
+	}
+
+	bool lookup(const T &key, uint64_t &sum) const
+	{
+		bool found = set.find(key) != set.end();
+		sum += found;
+		return found;
+	}
+
+	void remove(const T &key)
+	{
+		set.erase(key);
+	}
+
+	void iterate(uint64_t &sum) const
+	{
+		for (typename set_type::const_iterator it = set.begin(); it != set.end(); ++it) {
+			sum += (uint64_t) *it;
+		}
+	}
+
+	size_t copy()
+	{
+		copied = set;
+		return copied.size();
+	}
+};
+
+enum table_workload {
+	WORKLOAD_INSERT,
+	WORKLOAD_HIT,
+	WORKLOAD_MISS,
+	WORKLOAD_ITERATE,
+	WORKLOAD_COPY,
+	WORKLOAD_CHURN,
+	NUM_TABLE_WORKLOADS,
+};
+
+static const char *TABLE_WORKLOAD_NAMES[NUM_TABLE_WORKLOADS] = {
+	"insert", "hit", "miss", "iterate", "copy", "churn",
+};
+
+// Runs all workloads once on a fresh table.
+//  - insert:  n new keys
+//  - hit:     every key once, in a random order
+//  - miss:    n keys that aren't in the table
+//  - iterate: all elements
+//  - copy:    the whole table into a second buffer
+//  - churn:   n times, remove a random key that is in the table and insert a new one
+template <typename TTable, typename TKey>
+static void run_table_once(size_t n, double load, const std::vector<TKey> &keys,
+                           const std::vector<TKey> &new_keys, const std::vector<uint32_t> &order,
+                           measurement *results)
+{
+	TTable table(n, load);
+	uint64_t sum = 0;
+
+	results[WORKLOAD_INSERT] = measure(n, [&]() {
+		for (size_t i = 0; i < n; i++) {
+			table.insert(keys[i], (uint32_t) i);
+		}
+	});
+
+	results[WORKLOAD_HIT] = measure(n, [&]() {
+		for (size_t i = 0; i < n; i++) {
+			table.lookup(keys[order[i]], sum);
+		}
+	});
+
+	results[WORKLOAD_MISS] = measure(n, [&]() {
+		for (size_t i = 0; i < n; i++) {
+			table.lookup(new_keys[i], sum);
+		}
+	});
+
+	results[WORKLOAD_ITERATE] = measure(n, [&]() {
+		table.iterate(sum);
+	});
+
+	results[WORKLOAD_COPY] = measure(n, [&]() {
+		sum += table.copy();
+	});
+
+	results[WORKLOAD_CHURN] = measure(n, [&]() {
+		for (size_t i = 0; i < n; i++) {
+			table.remove(keys[order[i]]);
+			table.insert(new_keys[i], (uint32_t) i);
+		}
+	});
+
+	sink = sum;
+}
+
+template <typename TTable, typename TKey, typename TValue>
+static void run_table(const char *container, size_t n, size_t repeat, double load)
+{
+	if (!selected(container)) {
+		return;
+	}
+
+	std::vector<TKey> keys(n);
+	std::vector<TKey> new_keys(n);
+	for (size_t i = 0; i < n; i++) {
+		keys[i] = make_key<TKey>((uint32_t) i);
+		new_keys[i] = make_key<TKey>((uint32_t) (n + i));
+	}
+
+	std::vector<uint32_t> order = make_order(n, 0x2545f4914f6cdd1dull);
+
+	measurement best[NUM_TABLE_WORKLOADS];
+
+	for (size_t r = 0; r < repeat; r++) {
+		measurement results[NUM_TABLE_WORKLOADS];
+		run_table_once<TTable>(n, load, keys, new_keys, order, results);
+
+		for (size_t w = 0; w < NUM_TABLE_WORKLOADS; w++) {
+			if (r == 0 || results[w].ns_per_op < best[w].ns_per_op) {
+				best[w] = results[w];
+			}
+		}
+	}
+
+	for (size_t w = 0; w < NUM_TABLE_WORKLOADS; w++) {
+		print_result(container, TABLE_WORKLOAD_NAMES[w], sizeof(TKey), sizeof(TValue), load, n, best[w]);
+	}
+}
+
+template <typename TKey, typename TValue>
+static void run_maps(size_t n, size_t repeat)
+{
+	static const double LOADS[] = { 0.5, 0.75, 0.9 };
+
+	for (double load : LOADS) {
+		run_table<cf_hashmap_table<TKey, TValue, cf::hash_traits>, TKey, TValue>("cf::hashmap", n, repeat, load);
+		run_table<cf_hashmap_table<TKey, TValue, cf::hash_traits_backward_shift>, TKey, TValue>("cf::hashmap/backward_shift", n, repeat, load);
+		run_table<cf_hashmap_table<TKey, TValue, cf::hash_traits_bucketed>, TKey, TValue>("cf::hashmap/bucketed", n, repeat, load);
+		run_table<std_unordered_map_table<TKey, TValue>, TKey, TValue>("std::unordered_map", n, repeat, load);
+		run_table<dense_table<TKey, TValue>, TKey, TValue>("dense", n, repeat, load);
+	}
+}
+
+template <typename T>
+static void run_sets(size_t n, size_t repeat)
+{
+	static const double LOADS[] = { 0.5, 0.75, 0.9 };
+
+	for (double load : LOADS) {
+		run_table<cf_hashset_table<T, cf::hash_traits>, T, T>("cf::hashset", n, repeat, load);
+		run_table<cf_hashset_table<T, cf::hash_traits_backward_shift>, T, T>("cf::hashset/backward_shift", n, repeat, load);
+		run_table<std_unordered_set_table<T>, T, T>("std::unordered_set", n, repeat, load);
+	}
+}
+
+template <typename T>
+struct cf_memorypool_allocator {
+	aligned_buffer buffer;
+	cf::memorypool<T> pool;
+
+	explicit cf_memorypool_allocator(size_t n)
+		: buffer(CF_MEMORYPOOL_BUFFER_SIZE(T, n))
+	{
+		pool = cf::memorypool<T>::create(buffer.size, buffer.data);
+	}
+
+	T *allocate()
+	{
+		return pool.allocate();
+	}
+
+	void free(T *element)
+	{
+		pool.free(element);
+	}
+};
+
+template <typename T>
+struct new_delete_allocator {
+	explicit new_delete_allocator(size_t)
+	{
+	}
+
+	T *allocate()
+	{
+		return new T;
+	}
+
+	void free(T *element)
+	{
+		delete element;
+	}
+};
+
+enum pool_workload {
+	WORKLOAD_ALLOCATE,
+	WORKLOAD_FREE,
+	WORKLOAD_REALLOCATE,
+	NUM_POOL_WORKLOADS,
+};
+
+static const char *POOL_WORKLOAD_NAMES[NUM_POOL_WORKLOADS] = {
+	"allocate", "free", "reallocate",
+};
+
+// n allocations, then freeing all of them in a random order, then n allocations that
+// reuse the freed elements. Every element gets written once, like a real user would.
+template <typename TAllocator, typename T>
+static void run_allocator(const char *container, size_t n, size_t repeat)
+{
+	if (!selected(container)) {
+		return;
+	}
+
+	std::vector<uint32_t> order = make_order(n, 0x9e3779b97f4a7c15ull);
+	std::vector<T *> elements(n);
+
+	measurement best[NUM_POOL_WORKLOADS];
+
+	for (size_t r = 0; r < repeat; r++) {
+		TAllocator allocator(n);
+		measurement results[NUM_POOL_WORKLOADS];
+
+		results[WORKLOAD_ALLOCATE] = measure(n, [&]() {
+			for (size_t i = 0; i < n; i++) {
+				elements[i] = allocator.allocate();
+				*elements[i] = make_value<T>((uint32_t) i);
+			}
+		});
+
+		results[WORKLOAD_FREE] = measure(n, [&]() {
+			for (size_t i = 0; i < n; i++) {
+				allocator.free(elements[order[i]]);
+			}
+		});
+
+		results[WORKLOAD_REALLOCATE] = measure(n, [&]() {
+			for (size_t i = 0; i < n; i++) {
+				elements[i] = allocator.allocate();
+				*elements[i] = make_value<T>((uint32_t) i);
+			}
+		});
+
+		for (size_t i = 0; i < n; i++) {
+			allocator.free(elements[i]);
+		}
+
+		for (size_t w = 0; w < NUM_POOL_WORKLOADS; w++) {
+			if (r == 0 || results[w].ns_per_op < best[w].ns_per_op) {
+				best[w] = results[w];
+			}
+		}
+	}
+
+	for (size_t w = 0; w < NUM_POOL_WORKLOADS; w++) {
+		print_result(container, POOL_WORKLOAD_NAMES[w], 0, sizeof(T), 0.0, n, best[w]);
+	}
+}
+
+template <typename T>
+static void run_allocators(size_t n, size_t repeat)
+{
+	run_allocator<cf_memorypool_allocator<T>, T>("cf::memorypool", n, repeat);
+	run_allocator<new_delete_allocator<T>, T>("new/delete", n, repeat);
+}
+
+int main(int argc, char **argv)
+{
+	size_t n = 1 << 20;
+	size_t repeat = 3;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--csv") == 0) {
+			csv_output = true;
+		} else if (strcmp(argv[i], "--elements") == 0 && i + 1 < argc) {
+			n = (size_t) strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = (size_t) strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			container_filter = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [--csv] [--elements N] [--repeat N] [--filter TEXT]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (n == 0 || repeat == 0) {
+		fprintf(stderr, "--elements and --repeat have to be at least 1\n");
+		return 1;
+	}
+
+	if (!cache_misses.available()) {
+		fprintf(stderr, "cache miss counters are not available, reporting timings only\n");
+	}
+
+	print_header();
+
+	run_maps<uint32_t, uint32_t>(n, repeat);
+	run_maps<uint64_t, blob<56> >(n, repeat);
+
+	run_sets<uint32_t>(n, repeat);
+	run_sets<uint64_t>(n, repeat);
+
+	run_allocators<blob<16> >(n, repeat);
+	run_allocators<blob<64> >(n, repeat);
+
+	return 0;
+}
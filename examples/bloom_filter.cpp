@@ -0,0 +1,112 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "cf_bloom_filter.hpp"
+
+static uint32_t hash_int(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+int main(int argc, char **argv)
+{
+	{
+		printf("=== bloom filter tests ===\n");
+
+		alignas(64) uint8_t buffer[CF_BLOOM_FILTER_BUFFER_SIZE(1000, 10)];
+		auto filter = cf::bloom_filter::create(sizeof(buffer), buffer);
+
+		for (uint32_t i = 0; i < 1000; i++) {
+			filter.insert(hash_int(i));
+		}
+
+		// no false negatives
+		for (uint32_t i = 0; i < 1000; i++) {
+			assert(filter.may_contain(hash_int(i)));
+		}
+
+		uint32_t false_positives = 0;
+		for (uint32_t i = 1000; i < 101000; i++) {
+			false_positives += filter.may_contain(hash_int(i));
+		}
+
+		printf("false positive rate: %f\n", false_positives / 100000.0);
+		assert(false_positives < 5000);
+
+		filter.clear();
+		assert(!filter.may_contain(hash_int(0)));
+
+		cf::bloom_filter checked;
+		assert(!cf::bloom_filter::create(32, buffer, checked));
+		assert(!cf::bloom_filter::create(sizeof(buffer) - 1, buffer + 1, checked));
+		assert(cf::bloom_filter::create(sizeof(buffer), buffer, checked));
+	}
+
+	{
+		printf("=== filtered hashset tests ===\n");
+
+		typedef cf::filtered_hashset<uint32_t> set_type;
+
+		uint8_t set_buffer[CF_HASHSET_GET_BUFFER_SIZE(uint32_t, 128)];
+		alignas(64) uint8_t filter_buffer[CF_BLOOM_FILTER_BUFFER_SIZE(100, 10)];
+
+		auto set = set_type::create(sizeof(set_buffer), set_buffer, sizeof(filter_buffer), filter_buffer);
+
+		for (uint32_t i = 0; i < 100; i++) {
+			set.insert(hash_int(i), i);
+		}
+
+		assert(set.num_elements() == 100);
+
+		for (uint32_t i = 0; i < 100; i++) {
+			assert(set.has(hash_int(i), i));
+		}
+
+		// most of these get rejected by the filter without looking at the table
+		for (uint32_t i = 100; i < 200; i++) {
+			assert(!set.has(hash_int(i), i));
+		}
+
+		// the hash stays in the filter, but the table has the final word
+		set.remove(hash_int(42), 42);
+		assert(set.filter().may_contain(cf::bloom_filter_hash(hash_int(42))));
+		assert(!set.has(hash_int(42), 42));
+	}
+
+	{
+		printf("=== filtered hashmap tests ===\n");
+
+		typedef cf::filtered_hashmap<uint32_t, float> map_type;
+
+		uint8_t map_buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, float, 128)];
+		alignas(64) uint8_t filter_buffer[CF_BLOOM_FILTER_BUFFER_SIZE(100, 10)];
+
+		auto map = map_type::create(sizeof(map_buffer), map_buffer, sizeof(filter_buffer), filter_buffer);
+
+		for (uint32_t i = 0; i < 100; i++) {
+			map.set(hash_int(i), i, i * 0.5f);
+		}
+
+		float value = 0.0f;
+		assert(map.lookup(hash_int(10), 10, value) && value == 5.0f);
+		assert(!map.lookup(hash_int(1000), 1000, value));
+
+		*map.find(hash_int(10), 10) = 1.0f;
+		assert(map.lookup(hash_int(10), 10, value) && value == 1.0f);
+
+		map.remove(hash_int(10), 10);
+		assert(map.find(hash_int(10), 10) == nullptr);
+		assert(map.num_elements() == 99);
+	}
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Builds the same map once with `set()` and once with `bulk_build()` on all cores, then
+// copies it into a bigger buffer with the parallel `copy()`.
+// The library doesn't start threads on its own, the executor below does that.
+// Build with -pthread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cf_hashmap.hpp"
+
+static const size_t NUM_ELEMENTS = 1 << 22;
+
+typedef cf::hashmap<uint32_t, uint32_t, cf::hash_traits_pow2> map_type;
+
+// Runs every task on its own thread and waits for all of them.
+struct thread_executor {
+	template <typename TTask>
+	void operator()(size_t num_tasks, const TTask &task) const
+	{
+		std::vector<std::thread> threads;
+
+		for (size_t i = 0; i < num_tasks; i++) {
+			threads.push_back(std::thread([&task, i]() {
+				task(i);
+			}));
+		}
+
+		for (size_t i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+	}
+};
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_threads = std::thread::hardware_concurrency();
+	if (num_threads == 0) {
+		num_threads = 1;
+	}
+
+	uint32_t *hashes = new uint32_t[NUM_ELEMENTS];
+	uint32_t *keys = new uint32_t[NUM_ELEMENTS];
+	uint32_t *values = new uint32_t[NUM_ELEMENTS];
+
+	for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+		keys[i] = i;
+		hashes[i] = hash_key(i);
+		values[i] = i * 3;
+	}
+
+	size_t buffer_size = map_type::buffer_size(NUM_ELEMENTS * 3 / 2);
+	uint8_t *buffer = new uint8_t[buffer_size];
+
+	auto start = std::chrono::steady_clock::now();
+	map_type map = map_type::create(buffer_size, buffer);
+	for (size_t i = 0; i < NUM_ELEMENTS; i++) {
+		map.set(hashes[i], keys[i], values[i]);
+	}
+	printf("set():        %8.2f ms\n", elapsed_ms(start));
+
+	// holds the indices of the entries sorted by the part of the table they go into
+	size_t scratch_size = map_type::build_scratch_size(NUM_ELEMENTS);
+	uint8_t *scratch = new uint8_t[scratch_size];
+
+	start = std::chrono::steady_clock::now();
+	map = map_type::bulk_build(buffer_size, buffer, hashes, keys, values, NUM_ELEMENTS, scratch_size, scratch, num_threads, thread_executor());
+	printf("bulk_build(): %8.2f ms with %zu threads\n", elapsed_ms(start), num_threads);
+
+	size_t new_buffer_size = map_type::buffer_size(NUM_ELEMENTS * 3);
+	uint8_t *new_buffer = new uint8_t[new_buffer_size];
+
+	start = std::chrono::steady_clock::now();
+	map_type new_map = map.copy(new_buffer_size, new_buffer, scratch_size, scratch, num_threads, thread_executor());
+	printf("copy():       %8.2f ms with %zu threads\n", elapsed_ms(start), num_threads);
+
+	size_t errors = 0;
+	for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+		uint32_t value = 0;
+		if (!new_map.lookup(hashes[i], keys[i], value) || value != values[i]) {
+			errors++;
+		}
+	}
+
+	printf("elements: %zu, load factor %.3f -> %.3f, errors: %zu\n",
+	       new_map.num_elements(),
+	       map.load_factor(),
+	       new_map.load_factor(),
+	       errors);
+
+	delete[] new_buffer;
+	delete[] scratch;
+	delete[] buffer;
+	delete[] values;
+	delete[] keys;
+	delete[] hashes;
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Churn benchmark: a map is filled to a fixed number of live entries, then the
+// oldest entry gets removed and a new one inserted over and over, like a table of
+// expiring session keys.
+// With tombstones the probe chains only get longer, with backward shift deletion
+// they stay the same length as for a freshly built map.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "cf_hashmap.hpp"
+
+static const size_t CAPACITY = 1 << 16;
+static const size_t LIVE_ELEMENTS = CAPACITY * 3 / 4;
+static const size_t ROUNDS = 8;
+
+// keeps the lookups from being optimized away
+static volatile uint32_t sink;
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+template <typename TTraits>
+static void run_churn(const char *name)
+{
+	typedef cf::hashmap<uint32_t, uint32_t, TTraits> map_type;
+
+	size_t buffer_size = CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, CAPACITY);
+	uint8_t *buffer = new uint8_t[buffer_size];
+	map_type map = map_type::create(buffer_size, buffer);
+
+	printf("=== %s ===\n", name);
+	printf("%8s %10s %10s %10s %10s %12s %12s %12s\n", "round", "elements", "tombstones", "eff. load", "longest", "hit probes", "miss probes", "ns/lookup");
+
+	uint32_t oldest = 0;
+	uint32_t newest = 0;
+
+	for (; newest < LIVE_ELEMENTS; newest++) {
+		map.set(hash_key(newest), newest, newest);
+	}
+
+	for (size_t round = 0; round <= ROUNDS; round++) {
+		if (round > 0) {
+			// replace every live entry once per round
+			for (size_t i = 0; i < LIVE_ELEMENTS; i++) {
+				map.remove(hash_key(oldest), oldest);
+				oldest++;
+				map.set(hash_key(newest), newest, newest);
+				newest++;
+			}
+		}
+
+		size_t hit_probes = 0;
+		size_t miss_probes = 0;
+		size_t samples = 4096;
+
+		for (size_t i = 0; i < samples; i++) {
+			uint32_t hit = oldest + (uint32_t) (i * (LIVE_ELEMENTS / samples));
+			uint32_t miss = newest + (uint32_t) i;
+			hit_probes += map.probe_length(hash_key(hit), hit);
+			miss_probes += map.probe_length(hash_key(miss), miss);
+		}
+
+		uint32_t sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t key = oldest; key < newest; key++) {
+			uint32_t value = 0;
+			map.lookup(hash_key(key), key, value);
+			sum += value;
+		}
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count();
+		sink = sum;
+
+		cf::hash_stats stats = map.stats();
+
+		printf("%8zu %10zu %10zu %10.3f %10zu %12.2f %12.2f %12.2f\n",
+		       round,
+		       map.num_elements(),
+		       stats.num_tombstones,
+		       stats.effective_load_factor,
+		       stats.longest_run,
+		       hit_probes / (double) samples,
+		       miss_probes / (double) samples,
+		       ns / (newest - oldest));
+	}
+
+	delete[] buffer;
+}
+
+int main(int argc, char **argv)
+{
+	run_churn<cf::hash_traits>("tombstones");
+	run_churn<cf::hash_traits_backward_shift>("backward shift deletion");
+
+	return 0;
+}
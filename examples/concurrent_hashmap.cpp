@@ -0,0 +1,89 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// One writer keeps inserting, updating and removing entries while several readers
+// look them up. Every value encodes its key, so readers can check that they never see
+// a value that belongs to a different key.
+// Build with -pthread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "cf_concurrent_hashmap.hpp"
+
+typedef cf::concurrent_hashmap<uint32_t, uint64_t, cf::hash_traits_backward_shift> map_type;
+
+static const size_t CAPACITY = 1 << 14;
+static const uint32_t NUM_KEYS = CAPACITY / 2;
+static const size_t NUM_READERS = 3;
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+int main(int argc, char **argv)
+{
+	size_t buffer_size = map_type::buffer_size(CAPACITY);
+	uint8_t *buffer = new uint8_t[buffer_size];
+	map_type map = map_type::create(buffer_size, buffer);
+
+	std::atomic<bool> done(false);
+	std::atomic<size_t> started(0);
+	std::atomic<size_t> errors(0);
+	std::vector<std::thread> readers;
+
+	for (size_t r = 0; r < NUM_READERS; r++) {
+		readers.push_back(std::thread([&map, &done, &started, &errors, r]() {
+			started++;
+			size_t found = 0;
+			uint32_t key = (uint32_t) r;
+			while (!done.load(std::memory_order_relaxed)) {
+				key = (key + 7919) % NUM_KEYS;
+				uint64_t value = 0;
+				if (map.lookup(hash_key(key), key, value)) {
+					found++;
+					if ((uint32_t) value != key) {
+						errors++;
+					}
+				}
+			}
+			printf("reader %zu found %zu entries\n", r, found);
+		}));
+	}
+
+	// let the readers run before the writer starts
+	while (started.load() < NUM_READERS) {
+		std::this_thread::yield();
+	}
+
+	for (uint64_t round = 0; round < 64; round++) {
+		for (uint32_t key = 0; key < NUM_KEYS; key++) {
+			if ((key + round) % 3 == 0) {
+				map.remove(hash_key(key), key);
+			} else {
+				map.set(hash_key(key), key, (round << 32) | key);
+			}
+		}
+	}
+
+	done = true;
+	for (size_t r = 0; r < readers.size(); r++) {
+		readers[r].join();
+	}
+
+	printf("elements: %zu, errors: %zu\n", map.num_elements(), errors.load());
+
+	delete[] buffer;
+
+	return errors.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Several threads allocate elements from one pool and hand them to each other through
+// a few shared slots, so most elements get freed by a different thread than the one that
+// allocated them. Every element carries a flag that tells whether it is in use, so
+// handing out the same element twice would be noticed.
+// Build with -pthread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cf_concurrent_memorypool.hpp"
+
+static const size_t NUM_THREADS = 4;
+static const size_t NUM_ELEMENTS = 1 << 12;
+static const size_t NUM_SLOTS = 64;
+static const size_t ROUNDS = 1 << 18;
+
+struct message {
+	uint64_t payload;
+	uint32_t in_use;
+	uint32_t owner;
+};
+
+typedef cf::concurrent_memorypool<message> pool_type;
+
+int main(int argc, char **argv)
+{
+	size_t buffer_size = CF_CONCURRENT_MEMORYPOOL_BUFFER_SIZE(message, NUM_ELEMENTS);
+	// Cleared, so `in_use` is 0 in blocks that were never allocated before.
+	uint8_t *buffer = new uint8_t[buffer_size]();
+
+	pool_type pool = pool_type::create(buffer_size, buffer);
+
+	std::atomic<message *> slots[NUM_SLOTS];
+	for (size_t i = 0; i < NUM_SLOTS; i++) {
+		slots[i] = nullptr;
+	}
+
+	std::atomic<size_t> errors(0);
+	std::atomic<size_t> failed(0);
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < NUM_THREADS; t++) {
+		threads.push_back(std::thread([&pool, &slots, &errors, &failed, t]() {
+			pool_type::cache cache = {};
+			uint32_t rng = (uint32_t) t * 2654435761u + 1;
+
+			for (size_t round = 0; round < ROUNDS; round++) {
+				message *m = pool.allocate(cache);
+				if (m == nullptr) {
+					failed++;
+					continue;
+				}
+
+				if (__atomic_exchange_n(&m->in_use, 1, __ATOMIC_RELAXED) != 0) {
+					errors++;
+				}
+				m->owner = (uint32_t) t;
+				m->payload = round;
+
+				// swap it into a random slot and free whatever was there before
+				rng ^= rng << 13;
+				rng ^= rng >> 17;
+				rng ^= rng << 5;
+				message *other = slots[rng % NUM_SLOTS].exchange(m);
+
+				if (other != nullptr) {
+					__atomic_store_n(&other->in_use, 0, __ATOMIC_RELAXED);
+					pool.free(cache, other);
+				}
+			}
+
+			pool.flush(cache);
+		}));
+	}
+
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+	size_t in_slots = 0;
+	for (size_t i = 0; i < NUM_SLOTS; i++) {
+		if (slots[i].load() != nullptr) {
+			in_slots++;
+		}
+	}
+
+	printf("%zu threads: %.1f ns per allocate + free, %zu failed allocations\n",
+	       NUM_THREADS,
+	       ns / (NUM_THREADS * ROUNDS),
+	       failed.load());
+
+	// everything that isn't sitting in a slot went back to the central stack
+	if (pool.num_elements() != in_slots) {
+		errors++;
+	}
+
+	printf("elements in use: %zu, in slots: %zu, errors: %zu\n", pool.num_elements(), in_slots, errors.load());
+
+	delete[] buffer;
+
+	return errors.load() == 0 ? 0 : 1;
+}
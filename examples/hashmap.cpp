@@ -8,6 +8,47 @@
 
 #include "cf_hashmap.hpp"
 
+// Migrates a single slot per operation, so a migration takes long enough to fill up
+// the new table.
+struct slow_migration_traits : cf::hash_traits {
+	static const size_t migration_slots = 1;
+};
+
+// Counts the slots lookups inspect, see `stats()`.
+struct counting_traits : cf::hash_traits {
+	static const bool count_probes = true;
+};
+
+// A key that stores its string inline, and a view of a string that can be compared
+// with it without copying the string into a key first.
+struct name_key {
+	char bytes[32];
+};
+
+struct name_view {
+	const char *chars;
+	size_t length;
+};
+
+static bool operator==(const name_key &a, const name_key &b)
+{
+	return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+static bool operator==(const name_key &key, const name_view &view)
+{
+	return view.length < sizeof(key.bytes) && memcmp(key.bytes, view.chars, view.length) == 0 && key.bytes[view.length] == 0;
+}
+
+static uint32_t hash_name(const char *chars, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t) chars[i]) * 16777619u;
+	}
+	return hash;
+}
+
 int main(int argc, char **argv)
 {
 	using cf::hashmap;
@@ -61,6 +102,214 @@ int main(int argc, char **argv)
 			}
 		}
 
+		{
+			// for_each test
+			printf("=== for_each test ===\n");
+
+			map.for_each([](const uint32_t *key, uint16_t *value) {
+				*value += 1;
+				printf("map[%u] = %hu\n", *key, *value);
+			});
+		}
+
+	}
+
+	{
+		printf("=== pow2 capacity test ===\n");
+
+		uint8_t buffer[CF_HASHMAP_GET_BUFFER_SIZE_POW2(uint32_t, uint32_t, 100)];
+		auto map = hashmap<uint32_t, uint32_t, cf::hash_traits_pow2>::create(sizeof(buffer), buffer);
+		assert(map.capacity() == 128);
+
+		for (uint32_t i = 0; i < 100; i++) {
+			map.set(i * 2654435761u, i, i * i);
+		}
+		assert(map.num_elements() == 100);
+		assert(map.get(42 * 2654435761u, 42) == 42 * 42);
+
+		printf("load factor: %f\n", map.load_factor());
+
+		cf::hash_stats stats = map.stats();
+		assert(stats.num_elements == 100 && stats.num_tombstones == 0);
+		assert(stats.longest_run >= stats.max_probe_distance + 1);
+		printf("mean probe distance: %f, max: %u, longest run: %zu\n", stats.mean_probe_distance, stats.max_probe_distance, stats.longest_run);
+
+		uint32_t hashes[4] = { 1 * 2654435761u, 7 * 2654435761u, 200 * 2654435761u, 99 * 2654435761u };
+		uint32_t keys[4] = { 1, 7, 200, 99 };
+		uint32_t values[4];
+		bool found[4];
+
+		map.lookup_batch(hashes, keys, values, found, 4);
+		assert(found[0] && values[0] == 1);
+		assert(found[1] && values[1] == 49);
+		assert(!found[2]);
+		assert(found[3] && values[3] == 99 * 99);
+
+		// the default traits don't count anything
+		assert(map.stats().num_lookups == 0);
+	}
+
+	{
+		printf("=== probe counter test ===\n");
+
+		uint8_t buffer[CF_HASHMAP_GET_BUFFER_SIZE_TRAITS(counting_traits, uint32_t, uint32_t, 100)];
+		auto map = hashmap<uint32_t, uint32_t, counting_traits>::create(sizeof(buffer), buffer);
+		assert(map.stats().num_lookups == 0);
+
+		for (uint32_t i = 0; i < 50; i++) {
+			map.set(i * 2654435761u, i, i);
+		}
+		map.reset_probe_counters();
+
+		uint32_t value;
+		for (uint32_t i = 0; i < 100; i++) {
+			map.lookup(i * 2654435761u, i, value);
+		}
+
+		cf::hash_stats stats = map.stats();
+		assert(stats.num_lookups == 100);
+		assert(stats.num_lookup_probes >= 50);
+		printf("lookups: %llu, probes: %llu\n", (unsigned long long) stats.num_lookups, (unsigned long long) stats.num_lookup_probes);
+
+		map.reset_probe_counters();
+		assert(map.stats().num_lookups == 0 && map.stats().num_lookup_probes == 0);
+	}
+
+	{
+		printf("=== grow in place test ===\n");
+
+		// Pretend only the first part of the buffer was available at first and the
+		// allocation got extended later on.
+		uint8_t buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 256)];
+		auto map = hashmap<uint32_t, uint32_t>::create(CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 32), buffer);
+
+		for (uint32_t i = 0; i < 30; i++) {
+			map.set(i * 2654435761u, i, i + 1);
+		}
+		printf("old loadfactor: %f\n", map.load_factor());
+
+		bool grown = map.grow_in_place(sizeof(buffer));
+		assert(grown);
+		assert(map.capacity() == 256);
+		assert(map.num_elements() == 30);
+
+		for (uint32_t i = 0; i < 30; i++) {
+			assert(map.get(i * 2654435761u, i) == i + 1);
+		}
+		printf("new loadfactor: %f\n", map.load_factor());
+	}
+
+	{
+		printf("=== incremental resize test ===\n");
+
+		uint8_t old_buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 32)];
+		uint8_t new_buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 128)];
+
+		auto map = cf::incremental_hashmap<uint32_t, uint32_t>::create(sizeof(old_buffer), old_buffer);
+
+		for (uint32_t i = 0; i < 30; i++) {
+			map.set(i * 2654435761u, i, i + 1);
+		}
+
+		// a buffer that can't hold all entries is rejected
+		uint8_t small_buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 16)];
+		assert(!map.begin_resize(sizeof(small_buffer), small_buffer));
+		assert(!map.is_migrating());
+
+		bool resizing = map.begin_resize(sizeof(new_buffer), new_buffer);
+		assert(resizing);
+		map.set(100 * 2654435761u, 100, 101);
+		assert(map.is_migrating());
+		assert(map.num_elements() == 31);
+
+		// entries are found in either buffer while the migration is running, the const
+		// lookup doesn't migrate any slots
+		const auto &migrating = map;
+		for (uint32_t i = 0; i < 30; i++) {
+			uint32_t value = 0;
+			assert(migrating.lookup(i * 2654435761u, i, value) && value == i + 1);
+		}
+
+		// set() migrated the first 16 of the 32 slots
+		assert(map.migrate_step(8) == 8);
+		assert(map.migrate_step(8) == 0);
+		assert(!map.is_migrating());
+		assert(map.num_elements() == 31);
+		assert(map.get(7 * 2654435761u, 7) == 8);
+
+		printf("new loadfactor: %f\n", map.load_factor());
+	}
+
+	{
+		printf("=== incremental resize with a full table test ===\n");
+
+		typedef cf::incremental_hashmap<uint32_t, uint32_t, slow_migration_traits> slow_map;
+
+		uint8_t old_buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 64)];
+		uint8_t new_buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, uint32_t, 40)];
+
+		auto map = slow_map::create(sizeof(old_buffer), old_buffer);
+
+		for (uint32_t i = 0; i < 35; i++) {
+			map.set(i * 2654435761u, i, i + 1);
+		}
+
+		bool resizing = map.begin_resize(sizeof(new_buffer), new_buffer);
+		assert(resizing);
+
+		// new entries fill up the new table before the old entries got migrated
+		for (uint32_t i = 100; i < 110; i++) {
+			map.set(i * 2654435761u, i, i + 1);
+		}
+		assert(map.migrate_step(64) > 0);
+		assert(map.num_elements() == 45);
+
+		// entries that are still in the old table keep their new values
+		for (uint32_t i = 0; i < 35; i++) {
+			map.set(i * 2654435761u, i, i + 2);
+		}
+		assert(map.num_elements() == 45);
+
+		for (uint32_t i = 100; i < 110; i++) {
+			map.remove(i * 2654435761u, i);
+		}
+		while (map.migrate_step(8) > 0) {
+		}
+		assert(!map.is_migrating());
+		assert(map.num_elements() == 35);
+
+		for (uint32_t i = 0; i < 35; i++) {
+			assert(map.get(i * 2654435761u, i) == i + 2);
+		}
+	}
+
+	{
+		printf("=== in place access test ===\n");
+
+		struct counter {
+			uint32_t hits;
+			uint32_t last;
+		};
+
+		uint8_t buffer[CF_HASHMAP_GET_BUFFER_SIZE(uint32_t, counter, 64)];
+
+		auto map = cf::hashmap<uint32_t, counter>::create(sizeof(buffer), buffer);
+
+		for (uint32_t i = 0; i < 100; i++) {
+			uint32_t key = i % 10;
+			map.upsert(key * 2654435761u, key, [i](counter &c) {
+				c.hits++;
+				c.last = i;
+			});
+		}
+
+		map.get_or_insert(3 * 2654435761u, 3).hits += 5;
+
+		counter *c = map.find(3 * 2654435761u, 3);
+		assert(c && c->hits == 15 && c->last == 93);
+		assert(map.find(42 * 2654435761u, 42) == nullptr);
+
+		printf("map[3] = { hits: %u, last: %u }\n", c->hits, c->last);
 	}
 
 #define CHAR_HASH(str) ((uint32_t) ((uintptr_t) str & 0xFFFFFFFF)) // don't judge me
@@ -112,5 +361,126 @@ int main(int argc, char **argv)
 		}
 	}
 
+	{
+		printf("=== grow in place with limited probe distances test ===\n");
+
+		typedef hashmap<uint32_t, uint32_t, cf::hash_traits_distance> distance_map;
+
+		// Multiples of 1200 spread over 401 slots, but all share the home slot 0 of
+		// 1200 slots, which is further than `hash24_distance` can store.
+		struct colliding_hash {
+			uint32_t operator()(uint32_t key) const
+			{
+				return key * 1200;
+			}
+		};
+
+		static uint8_t buffer[distance_map::buffer_size(1201)];
+		auto map = distance_map::create(distance_map::buffer_size(401), buffer);
+
+		for (uint32_t i = 0; i < 200; i++) {
+			map.set(i * 1200, i, i + 1);
+		}
+		assert(map.num_elements() == 200);
+
+		bool grown = map.grow_in_place(distance_map::buffer_size(1200), colliding_hash());
+		assert(!grown);
+		assert(map.capacity() == 401);
+		assert(map.num_elements() == 200);
+
+		for (uint32_t i = 0; i < 200; i++) {
+			assert(map.get(i * 1200, i) == i + 1);
+		}
+
+		// With 1201 slots every entry gets a home slot of its own.
+		grown = map.grow_in_place(sizeof(buffer), colliding_hash());
+		assert(grown);
+		assert(map.capacity() == 1201);
+		assert(map.num_elements() == 200);
+
+		for (uint32_t i = 0; i < 200; i++) {
+			assert(map.get(i * 1200, i) == i + 1);
+		}
+	}
+
+	{
+		printf("=== static hashmap test ===\n");
+
+		// 64 slots stored inside of the map, no buffer and no division
+		cf::static_hashmap<uint32_t, uint32_t, 64> map;
+		static_assert(decltype(map)::capacity() == 64, "the capacity is known at compile time");
+
+		for (uint32_t i = 0; i < 48; i++) {
+			map.set(i * 2654435761u, i, i * i);
+		}
+		assert(map.num_elements() == 48);
+		assert(map.get(7 * 2654435761u, 7) == 49);
+
+		printf("loadfactor: %f, size: %zu bytes\n", map.load_factor(), sizeof(map));
+	}
+
+	{
+		printf("=== transparent lookup test ===\n");
+
+		uint8_t buffer[CF_HASHMAP_GET_BUFFER_SIZE(name_key, uint32_t, 16)];
+		auto map = hashmap<name_key, uint32_t>::create(sizeof(buffer), buffer);
+
+		const char *names[] = { "hashes", "keys", "values" };
+		for (uint32_t i = 0; i < 3; i++) {
+			name_key key = {};
+			strcpy(key.bytes, names[i]);
+			map.set(hash_name(key.bytes, strlen(key.bytes)), key, i);
+		}
+
+		// no name_key gets built for the lookups
+		name_view view = { "values", 6 };
+		assert(*map.find(hash_name(view.chars, view.length), view) == 2);
+
+		name_view missing = { "value", 5 };
+		assert(map.find(hash_name(missing.chars, missing.length), missing) == nullptr);
+
+		map.remove(hash_name(view.chars, view.length), view);
+		assert(map.num_elements() == 2);
+	}
+
+	{
+		printf("=== hasher policy test ===\n");
+
+		// The map hashes the keys itself, sequential ids get spread over the table.
+		uint8_t buffer[CF_HASHMAP_GET_BUFFER_SIZE_POW2(uint32_t, uint32_t, 128)];
+		auto map = hashmap<uint32_t, uint32_t, cf::hash_traits_pow2>::create(sizeof(buffer), buffer);
+
+		for (uint32_t id = 0; id < 100; id++) {
+			map.set(id, id * 2);
+		}
+
+		assert(map.get(42) == 84);
+		assert(map.find(100) == nullptr);
+		map.remove(42);
+		assert(map.find(42) == nullptr);
+
+		printf("mean probe distance: %f\n", map.stats().mean_probe_distance);
+
+		// Keys without data() and size() need a hasher policy of their own.
+		struct name_hasher {
+			static uint64_t hash(const name_key &key)
+			{
+				return cf::hash_bytes(key.bytes, strlen(key.bytes));
+			}
+		};
+
+		struct name_traits : cf::hash_traits {
+			typedef name_hasher hasher_policy;
+		};
+
+		uint8_t name_buffer[CF_HASHMAP_GET_BUFFER_SIZE(name_key, uint32_t, 16)];
+		auto names = hashmap<name_key, uint32_t, name_traits>::create(sizeof(name_buffer), name_buffer);
+
+		name_key key = {};
+		strcpy(key.bytes, "hashes");
+		names.set(key, 1);
+		assert(names.get(key) == 1);
+	}
+
 	return 0;
 }
@@ -43,6 +43,15 @@ int main(int argc, char **argv)
 		set.insert(13, 13);
 		set.insert(13, 21); // cause a hash collision
 
+		{
+			uint32_t hashes[3] = { 13, 1337, 42 };
+			uint32_t values[3] = { 21, 1337, 42 };
+			bool found[3];
+
+			set.has_batch(hashes, values, found, 3);
+			assert(found[0] && found[1] && !found[2]);
+		}
+
 		{
 			// iter test
 			printf("=== iterator test ===\n");
@@ -58,6 +67,17 @@ int main(int argc, char **argv)
 			printf("}\n");
 		}
 
+		{
+			// for_each test
+			printf("=== for_each test ===\n");
+
+			size_t count = 0;
+			set.for_each([&count](const uint32_t *) {
+				count++;
+			});
+			assert(count == set.num_elements());
+		}
+
 		{
 			// copy test
 			printf("=== copy test ===\n");
@@ -81,5 +101,79 @@ int main(int argc, char **argv)
 			printf("}\n");
 		}
 	}
+
+	{
+		printf("=== fingerprint test ===\n");
+
+		typedef hashset<uint32_t, cf::hash_traits_fingerprint> fingerprint_set;
+
+		uint8_t buffer[CF_HASHSET_GET_BUFFER_SIZE_TRAITS(cf::hash_traits_fingerprint, uint32_t, 64)];
+		auto set = fingerprint_set::create(sizeof(buffer), buffer);
+		assert(set.capacity() == 64);
+
+		for (uint32_t i = 0; i < 48; i++) {
+			set.insert(i * 2654435761u, i);
+		}
+		assert(set.num_elements() == 48);
+		assert(set.has(7 * 2654435761u, 7));
+		assert(!set.has(50 * 2654435761u, 50));
+
+		// only fingerprints are stored, so copying needs to hash the values again
+		uint8_t new_buffer[CF_HASHSET_GET_BUFFER_SIZE_TRAITS(cf::hash_traits_fingerprint, uint32_t, 128)];
+		auto new_set = set.copy(sizeof(new_buffer), new_buffer, [](uint32_t value) { return value * 2654435761u; });
+		assert(new_set.num_elements() == 48);
+		assert(new_set.has(7 * 2654435761u, 7));
+
+		printf("new loadfactor: %f\n", new_set.load_factor());
+	}
+	{
+		printf("=== static hashset test ===\n");
+
+		cf::static_hashset<uint32_t, 100> set;
+
+		for (uint32_t i = 0; i < 80; i++) {
+			set.insert(i * 2654435761u, i);
+		}
+		assert(set.num_elements() == 80);
+		assert(set.has(7 * 2654435761u, 7));
+		assert(!set.has(80 * 2654435761u, 80));
+	}
+	{
+		printf("=== set operations test ===\n");
+
+		typedef cf::hashset<uint32_t> set_type;
+
+		uint8_t buffer_a[CF_HASHSET_GET_BUFFER_SIZE(uint32_t, 128)];
+		uint8_t buffer_b[CF_HASHSET_GET_BUFFER_SIZE(uint32_t, 128)];
+		uint8_t buffer_out[CF_HASHSET_GET_BUFFER_SIZE(uint32_t, 256)];
+
+		auto evens = set_type::create(sizeof(buffer_a), buffer_a);
+		auto threes = set_type::create(sizeof(buffer_b), buffer_b);
+
+		for (uint32_t i = 0; i < 100; i++) {
+			if (i % 2 == 0) {
+				evens.insert(i * 2654435761u, i);
+			}
+			if (i % 3 == 0) {
+				threes.insert(i * 2654435761u, i);
+			}
+		}
+
+		// the stored hashes are reused, no hash function is needed
+		auto both = set_type::create(sizeof(buffer_out), buffer_out);
+		assert(evens.intersect_into(threes, both));
+		assert(both.num_elements() == 17);
+		assert(both.has(6 * 2654435761u, 6));
+		assert(evens.contains_all(both) && threes.contains_all(both));
+
+		auto either = set_type::create(sizeof(buffer_out), buffer_out);
+		assert(evens.union_into(threes, either));
+		assert(either.num_elements() == 67);
+
+		auto only_evens = set_type::create(sizeof(buffer_out), buffer_out);
+		assert(evens.difference_into(threes, only_evens));
+		assert(only_evens.num_elements() == 33);
+		assert(!only_evens.has(6 * 2654435761u, 6));
+	}
 	return 0;
 }
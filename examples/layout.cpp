@@ -0,0 +1,141 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Layout benchmark: the same tables are built once with the default Struct-of-Arrays
+// layout and once with cache line sized buckets, then random hits, random misses and a
+// full iteration are timed for a few key and value sizes.
+// The tables are a lot bigger than the caches, so every random lookup is a cache miss.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+#include "cf_hashmap.hpp"
+
+static const size_t NUM_ELEMENTS = 1 << 20;
+static const size_t NUM_LOOKUPS = 1 << 20;
+
+// keeps the lookups from being optimized away
+static volatile uint64_t sink;
+
+struct bucketed_pow2 : cf::hash_traits_bucketed {
+	typedef cf::capacity_pow2 capacity_policy;
+};
+
+template <size_t Size>
+struct blob {
+	uint8_t bytes[Size];
+};
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+template <typename TValue>
+static TValue make_value(uint32_t i)
+{
+	TValue value = {};
+	memcpy(&value, &i, sizeof(i) < sizeof(value) ? sizeof(i) : sizeof(value));
+	return value;
+}
+
+template <typename TValue>
+static uint32_t read_value(const TValue &value)
+{
+	uint32_t i = 0;
+	memcpy(&i, &value, sizeof(i) < sizeof(value) ? sizeof(i) : sizeof(value));
+	return i;
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+template <typename TKey, typename TValue, typename TTraits>
+static void run_layout(const char *name)
+{
+	typedef cf::hashmap<TKey, TValue, TTraits> map_type;
+
+	size_t buffer_size = map_type::buffer_size(NUM_ELEMENTS * 4 / 3);
+
+	// Buckets only line up with cache lines if the buffer does.
+	uint8_t *allocation = new uint8_t[buffer_size + 64];
+	uint8_t *buffer = (uint8_t *) (((uintptr_t) allocation + 63) & ~(uintptr_t) 63);
+
+	map_type map = map_type::create(buffer_size, buffer);
+
+	for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+		TKey key = (TKey) i;
+		map.set(hash_key(i), key, make_value<TValue>(i));
+	}
+
+	uint64_t sum = 0;
+	uint32_t step = 2654435761u;
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+		uint32_t k = (i * step) % NUM_ELEMENTS;
+		const TValue *value = map.find(hash_key(k), (TKey) k);
+		sum += read_value(*value);
+	}
+	double hit_ns = elapsed_ns(start) / NUM_LOOKUPS;
+
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+		uint32_t k = NUM_ELEMENTS + (i * step) % NUM_ELEMENTS;
+		sum += map.find(hash_key(k), (TKey) k) != nullptr;
+	}
+	double miss_ns = elapsed_ns(start) / NUM_LOOKUPS;
+
+	start = std::chrono::steady_clock::now();
+	auto iter = map.iter_start();
+	TKey key;
+	TValue value;
+	while (map.iter_next(iter, key, value)) {
+		sum += read_value(value);
+	}
+	double iter_ns = elapsed_ns(start) / NUM_ELEMENTS;
+
+	sink = sum;
+
+	printf("%-24s %-10s %10.2f %10.2f %10.2f %8.1f\n",
+	       name,
+	       TTraits::layout_policy::template layout<uint32_t, TKey, TValue>::contiguous_slots ? "soa" : "bucketed",
+	       hit_ns,
+	       miss_ns,
+	       iter_ns,
+	       buffer_size / (1024.0 * 1024.0));
+
+	delete[] allocation;
+}
+
+template <typename TKey, typename TValue>
+static void run_both(const char *name)
+{
+	run_layout<TKey, TValue, cf::hash_traits_pow2>(name);
+	run_layout<TKey, TValue, bucketed_pow2>(name);
+}
+
+int main(int argc, char **argv)
+{
+	printf("%-24s %-10s %10s %10s %10s %8s\n", "key/value", "layout", "ns/hit", "ns/miss", "ns/iter", "MiB");
+
+	run_both<uint32_t, uint32_t>("uint32_t/uint32_t");
+	run_both<uint64_t, uint64_t>("uint64_t/uint64_t");
+	run_both<uint32_t, blob<16> >("uint32_t/16 bytes");
+	run_both<uint64_t, blob<48> >("uint64_t/48 bytes");
+	run_both<uint64_t, blob<256> >("uint64_t/256 bytes");
+
+	return 0;
+}
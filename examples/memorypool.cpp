@@ -55,5 +55,94 @@ int main(int argc, char **argv)
 		assert(pool.allocate() == nullptr);
 
 	}
+
+	{
+		printf("=== batch test ===\n");
+
+		uint8_t buffer[CF_MEMORYPOOL_BUFFER_SIZE(Velocity, 8)];
+		auto pool = cf::memorypool<Velocity>::create(sizeof(buffer), buffer);
+
+		Velocity *ptrs[10];
+
+		// only 8 fit
+		assert(pool.allocate_n(ptrs, 10) == 8);
+		assert(pool.num_elements() == 8);
+
+		pool.free_n(ptrs + 2, 4);
+		assert(pool.num_elements() == 4);
+
+		assert(pool.allocate_n(ptrs + 2, 4) == 4);
+		assert(pool.allocate() == nullptr);
+
+		pool.free_n(ptrs, 8);
+		printf("load factor: %f\n", pool.load_factor());
+	}
+
+	{
+		printf("=== chunked pool test ===\n");
+
+		// 16 bit indices: 4 bits for the chunk, 12 bits for the offset in it
+		typedef cf::chunked_memorypool<Velocity, uint16_t> chunked_pool;
+
+		uint8_t first[CF_MEMORYPOOL_BUFFER_SIZE_CUSTOM_IDX(Velocity, uint16_t, 4)];
+		uint8_t second[CF_MEMORYPOOL_BUFFER_SIZE_CUSTOM_IDX(Velocity, uint16_t, 4)];
+
+		auto pool = chunked_pool::create(sizeof(first), first);
+
+		Velocity *ptrs[8];
+		for (int i = 0; i < 4; i++) {
+			ptrs[i] = pool.allocate();
+		}
+		assert(pool.allocate() == nullptr);
+
+		// the pool is full, give it another buffer
+		assert(pool.add_chunk(sizeof(second), second));
+		for (int i = 4; i < 8; i++) {
+			ptrs[i] = pool.allocate();
+			assert(ptrs[i] != nullptr);
+		}
+
+		printf("capacity: %zu, load factor: %f\n", pool.capacity(), pool.load_factor());
+
+		// the first chunk still has elements in use
+		pool.free(ptrs[0]);
+		for (int i = 4; i < 8; i++) {
+			pool.free(ptrs[i]);
+		}
+		assert(pool.try_reclaim_chunk() == second);
+		assert(pool.try_reclaim_chunk() == nullptr);
+		assert(pool.num_chunks() == 1);
+
+		// the freed element of the first chunk is still on the free list
+		assert(pool.allocate() == ptrs[0]);
+		assert(pool.allocate() == nullptr);
+	}
+
+	{
+		printf("=== static pool test ===\n");
+
+		// the elements are part of the pool, a global one needs no setup at runtime
+		static cf::static_memorypool<Velocity, 4, uint8_t> pool;
+
+		Velocity *ptrs[4];
+		for (int i = 0; i < 4; i++) {
+			ptrs[i] = pool.allocate();
+			assert(ptrs[i] != nullptr);
+		}
+		assert(pool.allocate() == nullptr);
+
+		pool.free(ptrs[2]);
+		assert(pool.allocate() == ptrs[2]);
+
+		// the free list is used up before new elements get handed out
+		pool.free(ptrs[0]);
+		pool.free(ptrs[3]);
+		assert(pool.allocate() == ptrs[3]);
+		assert(pool.allocate() == ptrs[0]);
+		assert(pool.allocate() == nullptr);
+
+		printf("load factor: %f\n", pool.load_factor());
+	}
+
 	return 0;
 }
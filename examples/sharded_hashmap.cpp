@@ -0,0 +1,107 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Several threads insert and remove their own keys in a sharded map at the same time,
+// afterwards the fullest shard gets moved to a bigger buffer.
+// Build with -pthread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cf_concurrent_hashmap.hpp"
+
+static const size_t NUM_SHARDS = 16;
+static const size_t NUM_THREADS = 4;
+static const uint32_t KEYS_PER_THREAD = 1 << 14;
+
+typedef cf::sharded_hashmap<uint32_t, uint32_t, NUM_SHARDS, cf::hash_traits_backward_shift> map_type;
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+int main(int argc, char **argv)
+{
+	size_t buffer_size = map_type::buffer_size(NUM_THREADS * KEYS_PER_THREAD * 2);
+	uint8_t *buffer = new uint8_t[buffer_size];
+	map_type map = map_type::create(buffer_size, buffer);
+
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < NUM_THREADS; t++) {
+		threads.push_back(std::thread([&map, t]() {
+			uint32_t first = (uint32_t) t * KEYS_PER_THREAD;
+			for (uint32_t key = first; key < first + KEYS_PER_THREAD; key++) {
+				map.set(hash_key(key), key, key * 2);
+			}
+			// remove every fourth key again
+			for (uint32_t key = first; key < first + KEYS_PER_THREAD; key += 4) {
+				map.remove(hash_key(key), key);
+			}
+		}));
+	}
+
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+	printf("%zu threads: %zu elements in %.2f ms, load factor %.3f\n",
+	       NUM_THREADS,
+	       map.num_elements(),
+	       ms,
+	       map.load_factor());
+
+	size_t errors = 0;
+	for (uint32_t key = 0; key < NUM_THREADS * KEYS_PER_THREAD; key++) {
+		uint32_t value = 0;
+		bool found = map.lookup(hash_key(key), key, value);
+		if (found != (key % 4 != 0) || (found && value != key * 2)) {
+			errors++;
+		}
+	}
+
+	// move the fullest shard into a buffer with twice the size
+	size_t fullest = 0;
+	for (size_t i = 1; i < map.num_shards(); i++) {
+		if (map.shard_load_factor(i) > map.shard_load_factor(fullest)) {
+			fullest = i;
+		}
+	}
+
+	size_t shard_buffer_size = 2 * buffer_size / map.num_shards();
+	uint8_t *shard_buffer = new uint8_t[shard_buffer_size];
+
+	printf("shard %zu: load factor %.3f", fullest, map.shard_load_factor(fullest));
+	map.copy_shard(fullest, shard_buffer_size, shard_buffer);
+	printf(" -> %.3f\n", map.shard_load_factor(fullest));
+
+	for (uint32_t key = 0; key < NUM_THREADS * KEYS_PER_THREAD; key++) {
+		uint32_t value = 0;
+		if (map.lookup(hash_key(key), key, value) != (key % 4 != 0)) {
+			errors++;
+		}
+	}
+
+	printf("elements: %zu, capacity: %zu, errors: %zu\n", map.num_elements(), map.capacity(), errors);
+
+	// the old part of the first buffer stays in use by the other shards
+	delete[] shard_buffer;
+	delete[] buffer;
+
+	return errors == 0 ? 0 : 1;
+}
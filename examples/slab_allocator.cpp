@@ -0,0 +1,102 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "cf_slab_allocator.hpp"
+
+typedef cf::slab_allocator<16, 256> slab_type;
+
+int main(int argc, char **argv)
+{
+	printf("=== slab allocator tests ===\n");
+
+	// 16, 32, 64, 128 and 256 bytes
+	assert(slab_type::NUM_CLASSES == 5);
+
+	assert(slab_type::size_class(1) == 0);
+	assert(slab_type::size_class(16) == 0);
+	assert(slab_type::size_class(17) == 1);
+	assert(slab_type::size_class(100) == 3);
+	assert(slab_type::size_class(256) == 4);
+	assert(slab_type::size_class(257) == slab_type::NUM_CLASSES);
+
+	{
+		size_t num_blocks[slab_type::NUM_CLASSES] = { 8, 4, 4, 2, 2 };
+
+		alignas(64) static uint8_t buffer[2048];
+		assert(slab_type::buffer_size(num_blocks) <= sizeof(buffer));
+
+		auto slab = slab_type::create(sizeof(buffer), buffer, num_blocks);
+
+		void *small[8];
+		for (int i = 0; i < 8; i++) {
+			small[i] = slab.allocate(12);
+			assert(small[i] != nullptr);
+			memset(small[i], i, 12);
+		}
+
+		// the 16 byte class is full, the others aren't touched
+		assert(slab.allocate(12) == nullptr);
+		assert(slab.num_elements(0) == 8);
+		assert(slab.num_elements(1) == 0);
+
+		void *big = slab.allocate(200);
+		assert(big != nullptr);
+		assert(((uintptr_t) big & 63) == 0);
+		memset(big, 0xff, 200);
+
+		printf("load factor of class 0: %f\n", slab.load_factor(0));
+		printf("load factor of class 4: %f\n", slab.load_factor(4));
+
+		slab.free(small[3]);
+		slab.free(small[5]);
+		assert(slab.num_elements(0) == 6);
+
+		// freed blocks are used again
+		void *a = slab.allocate(16);
+		void *b = slab.allocate(1);
+		assert((a == small[3] && b == small[5]) || (a == small[5] && b == small[3]));
+
+		slab.free(big);
+		assert(slab.num_elements() == 8);
+
+		assert(slab.allocate(1000) == nullptr);
+	}
+
+	{
+		// every class gets about the same number of bytes
+		alignas(64) static uint8_t buffer[4096];
+		auto slab = slab_type::create(sizeof(buffer), buffer);
+
+		for (size_t c = 0; c < slab_type::NUM_CLASSES; c++) {
+			printf("class %zu: %zu blocks of %zu bytes\n", c, slab.capacity(c), slab_type::class_size(c));
+
+			assert(slab.capacity(c) > 0);
+
+			for (size_t i = 0; i < slab.capacity(c); i++) {
+				assert(slab.allocate(slab_type::class_size(c)) != nullptr);
+			}
+			assert(slab.allocate(slab_type::class_size(c)) == nullptr);
+			assert(slab.load_factor(c) == 1.0f);
+		}
+	}
+
+	{
+		// a wide range of classes
+		typedef cf::slab_allocator<16, 16384> wide_type;
+		assert(wide_type::NUM_CLASSES == 11);
+
+		for (size_t size = 1; size <= 16384; size++) {
+			size_t c = wide_type::size_class(size);
+			assert(wide_type::class_size(c) >= size);
+			assert(c == 0 || wide_type::class_size(c - 1) < size);
+		}
+		assert(wide_type::size_class(16385) == wide_type::NUM_CLASSES);
+	}
+
+	return 0;
+}
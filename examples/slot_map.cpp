@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "cf_slot_map.hpp"
+
+struct Velocity {
+	float x;
+	float y;
+};
+
+int main(int argc, char **argv)
+{
+	printf("=== slot map tests ===\n");
+
+	typedef cf::slot_map<Velocity> slot_map_type;
+
+	uint8_t buffer[CF_SLOT_MAP_BUFFER_SIZE(Velocity, 4)];
+	auto map = slot_map_type::create(sizeof(buffer), buffer);
+
+	assert(map.capacity() == 4);
+
+	slot_map_type::handle handles[4];
+	for (int i = 0; i < 4; i++) {
+		handles[i] = map.insert(Velocity { (float) i, 0.0f });
+		assert(handles[i] != slot_map_type::null_handle);
+	}
+
+	assert(map.insert(Velocity { 4.0f, 0.0f }) == slot_map_type::null_handle);
+
+	assert(map.remove(handles[1]));
+	assert(!map.contains(handles[1]));
+	assert(map.get(handles[1]) == nullptr);
+
+	// the slot gets reused, but the old handle stays invalid
+	slot_map_type::handle reused = map.insert(Velocity { 5.0f, 0.0f });
+	assert(reused != handles[1]);
+	assert(map.get(handles[1]) == nullptr);
+	assert(map.get(reused)->x == 5.0f);
+
+	// the elements are always packed
+	for (size_t i = 0; i < map.num_elements(); i++) {
+		Velocity &v = map.data()[i];
+		assert(map.get(map.handle_at(i)) == &v);
+		printf("element %zu: (%f, %f)\n", i, v.x, v.y);
+	}
+
+	printf("load factor: %f\n", map.load_factor());
+
+	// A map created in a buffer that was used before starts its slots over, so handles
+	// of the old map don't match the slots of the new one, even though the slot of
+	// `reused` held the same generation.
+	auto fresh = slot_map_type::create(sizeof(buffer), buffer);
+	slot_map_type::handle first = fresh.insert(Velocity { 6.0f, 0.0f });
+	slot_map_type::handle second = fresh.insert(Velocity { 7.0f, 0.0f });
+	assert(!fresh.contains(reused));
+	assert(fresh.get(first)->x == 6.0f);
+	assert(fresh.get(second)->x == 7.0f);
+
+	return 0;
+}
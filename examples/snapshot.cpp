@@ -0,0 +1,114 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Builds a map, stores it in a snapshot file and maps that file back into memory, where
+// it can be used right away without inserting anything again.
+// Uses mmap(), so this needs a POSIX system.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cf_hashmap.hpp"
+
+static const size_t NUM_ELEMENTS = 1 << 16;
+
+typedef cf::hashmap<uint32_t, uint64_t, cf::hash_traits_pow2> map_type;
+
+static uint32_t hash_key(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return key;
+}
+
+static bool save(const char *path)
+{
+	size_t buffer_size = map_type::buffer_size(NUM_ELEMENTS * 2);
+	uint8_t *buffer = new uint8_t[buffer_size];
+
+	map_type map = map_type::create(buffer_size, buffer);
+	for (uint32_t key = 0; key < NUM_ELEMENTS; key++) {
+		map.set(hash_key(key), key, (uint64_t) key * key);
+	}
+
+	uint64_t header[map_type::snapshot_header_size / sizeof(uint64_t)];
+	map.save_header(header);
+
+	const cf::hashmap_snapshot_header *info = (const cf::hashmap_snapshot_header *) header;
+
+	FILE *file = fopen(path, "wb");
+	bool ok = file != nullptr;
+	ok = ok && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	ok = ok && fwrite(buffer, 1, info->table_size, file) == info->table_size;
+	if (file) {
+		ok = fclose(file) == 0 && ok;
+	}
+
+	printf("saved %zu elements, %llu bytes of table\n", map.num_elements(), (unsigned long long) info->table_size);
+
+	delete[] buffer;
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "hashmap.snapshot";
+
+	if (!save(path)) {
+		printf("couldn't write %s\n", path);
+		return 1;
+	}
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		printf("couldn't open %s\n", path);
+		return 1;
+	}
+
+	// A private mapping, lookups never write to the table but it stays modifiable in
+	// memory without changing the file.
+	void *data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		printf("couldn't map %s\n", path);
+		return 1;
+	}
+
+	map_type map;
+	if (!map_type::attach(st.st_size, data, map)) {
+		printf("%s isn't a snapshot of this map type\n", path);
+		return 1;
+	}
+
+	size_t errors = 0;
+	for (uint32_t key = 0; key < NUM_ELEMENTS * 2; key++) {
+		uint64_t value = 0;
+		bool found = map.lookup(hash_key(key), key, value);
+		if (found != (key < NUM_ELEMENTS) || (found && value != (uint64_t) key * key)) {
+			errors++;
+		}
+	}
+
+	printf("attached %zu elements, load factor %.3f, errors: %zu\n", map.num_elements(), map.load_factor(), errors);
+
+	// a snapshot of a different map type gets rejected
+	cf::hashmap<uint32_t, uint32_t, cf::hash_traits_pow2> other;
+	if (cf::hashmap<uint32_t, uint32_t, cf::hash_traits_pow2>::attach(st.st_size, data, other)) {
+		errors++;
+	}
+
+	munmap(data, st.st_size);
+	remove(path);
+
+	return errors == 0 ? 0 : 1;
+}